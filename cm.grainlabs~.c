@@ -29,12 +29,63 @@
 #include "ext_obex.h"
 #include "cmstereo.h" // for cm_pan
 #include "cmutil.h" // for cm_random
+#include "ext_critical.h" // for the analysis index lock
+#include "ext_hashtab.h" // for the shared analysis index registry
+#include "ext_systhread.h" // for the analysis thread
 #include <stdlib.h> // for arc4random_uniform
-#define MAX_GRAINLENGTH 300 // max grain length in ms
-#define MIN_GRAINLENGTH 1 // min grain length in ms
+#include <math.h> // for sqrt, sin, cos in the analysis routine
+#define MAX_GRAINLENGTH 20000 // upper bound for the maxlength attribute in ms
+#define MIN_GRAINLENGTH 1 // lower bound for the minlength attribute in ms
+#define DEFAULT_MAXLENGTH 300 // default max grain length in ms
+#define DEFAULT_MINLENGTH 1 // default min grain length in ms
+#define STREAM_GRAINLENGTH 500 // grains reading a longer source span than this (ms) use the streaming read path
+#define PREFETCH_FRAMES 256 // number of frames to prefetch ahead of the read head in the streaming read path
+#if defined(__GNUC__) || defined(__clang__)
+#define CM_PREFETCH(addr) __builtin_prefetch((addr), 0, 3) // read access, keep in all cache levels (the lines are read within the next vector)
+#else
+#define CM_PREFETCH(addr)
+#endif
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h> // for _mm_getcsr, _mm_setcsr
+#endif
 #define MAX_PITCH 10 // max pitch
+#define COUNT_TOLERANCE 1e-6 // rounding tolerance in samples when a grain duration is converted into a sample count
+#define MAX_DENSITY 100000 // max grain density in grains per second for the internal scheduler
+#define MIN_ONSET_INTERVAL 0.1 // shortest jittered inter-onset interval as a fraction of the nominal period (bounds the onsets per vector)
 #define ARGUMENTS 3 // constant number of arguments required for the external
 #define MAXGRAINS 128 // maximum number of simultaneously playing grains
+#define INDEX_FRAMESIZE 1024 // analysis frame size in samples (power of 2 for the fft)
+#define INDEX_HOPSIZE 512 // analysis hop size in samples
+#define INDEX_ONSET_RATIO 2.0 // rms increase between frames required for an onset marker
+#define INDEX_ONSET_FLOOR 0.01 // min rms for an onset marker (-40 dB)
+#define MAX_CENTROID 100000 // default upper limit for the centroid selection range in Hz
+
+
+/************************************************************************************************************************/
+/* ANALYSIS INDEX STRUCTURES                                                                                            */
+/************************************************************************************************************************/
+typedef struct _cmgrainlabs_frame {
+	float rms; // rms amplitude of the analysis frame
+	float centroid; // spectral centroid of the analysis frame in Hz
+	char onset; // onset marker (1 if the frame starts with an onset)
+} t_cmgrainlabs_frame;
+
+typedef struct _cmgrainlabs_index {
+	t_symbol *name; // name of the analysed sample buffer
+	long refcount; // number of instances sharing this index
+	short dirty; // checkflag if the buffer has been modified since the last analysis
+	long framecount; // number of analysis frames
+	t_cmgrainlabs_frame *frames; // analysis table (one entry per hop)
+	t_critical frames_lock; // lock for swapping and reading the analysis table (never taken by the perform routine)
+	t_critical lock; // lock for swapping the crossing index (read by the perform routine), the user list and the thread flags
+	t_int32 *crossings; // positions of all upward zero crossings in the sample buffer (ascending)
+	long crossingcount; // number of entries in the crossing index
+	t_systhread thread; // analysis thread (NULL if none has been started since the last join)
+	short busy; // checkflag if the analysis thread is running
+	short cancel; // checkflag to stop the analysis thread early (last instance released the index)
+	t_buffer_obj *buffer; // sample buffer analysed by the thread
+	struct _cmgrainlabs *users; // instances sharing this index, notified when an analysis has finished
+} t_cmgrainlabs_index;
 
 
 /************************************************************************************************************************/
@@ -47,6 +98,8 @@ typedef struct _cmgrainlabs {
 	t_symbol *window_name; // window buffer name
 	t_buffer_ref *w_buffer; // window buffer reference
 	double m_sr; // system millisampling rate (samples per milliseconds = sr * 0.001)
+	double m_sr_inv; // reciprocal of the millisampling rate (milliseconds per sample), precomputed in the dsp method
+	double stream_frames; // min source span in samples for the streaming read path, precomputed in the dsp method
 	double startmin_float; // grain start min value received from float inlet
 	double startmax_float; // grain start max value received from float inlet
 	double lengthmin_float; // used to store the min length value received from float inlet
@@ -57,13 +110,24 @@ typedef struct _cmgrainlabs {
 	double panmax_float; // used to store the max pan value received from the float inlet
 	short connect_status[8]; // array for signal inlet connection statuses
 	short *busy; // array used to store the flag if a grain is currently playing or not
-	long *grainpos; // used to store the current playback position per grain
-	long *start; // used to store the start position in the buffer for each grain
-	long *t_length; // current grain length before pitch adjustment
-	long *gr_length; // current grain length after pitch adjustment
+	double *grainpos; // normalized playback position per grain (0.0 - 1.0, sample rate independent)
+	double *grainstep; // playback position increment per output sample for each grain (depends on sample rate)
+	double *start; // used to store the start position in the buffer for each grain (fractional after a sample rate change)
+	double *t_length; // current grain duration in ms before pitch adjustment (sample rate independent)
+	double *gr_length; // current grain length in buffer samples after pitch adjustment
+	long *remaining; // number of output samples left to play for each grain (the grain ends when it reaches 0)
+	short *streaming; // flag per grain if it is rendered with the streaming read path (long grains)
+	long *prefetchpos; // next buffer frame to be prefetched for streaming grains
 	double *pan_left; // pan information for left channel for each grain
 	double *pan_right; // pan information for right channel for each grain
+	float *f_pan_left; // pan information for left channel for each grain (float32 precision mode)
+	float *f_pan_right; // pan information for right channel for each grain (float32 precision mode)
+	float *f_wpos; // window read position in window frames for each grain (float32 precision mode)
+	float *f_wstep; // window read position increment per output sample for each grain (float32 precision mode)
 	double tr_prev; // trigger sample from previous signal vector (required to check if input ramp resets to zero)
+	double next_onset; // internal scheduler: time of the next grain onset in samples relative to the start of the next signal vector
+	double *onsets; // internal scheduler: grain onset times (in samples, sub-sample precision) scheduled for the current signal vector
+	long onsets_size; // allocated size of the onsets array
 	short grains_limit; // user defined maximum number of grains
 	short grains_limit_old; // used to store the previous grains count limit when user changes the limit via the "limit" message
 	short limit_modified; // checkflag to see if user changed grain limit through "limit" method
@@ -74,14 +138,67 @@ typedef struct _cmgrainlabs {
 	t_atom_long attr_winterp; // attribute: window interpolation on/off
 	t_atom_long attr_sinterp; // attribute: window interpolation on/off
 	t_atom_long attr_zero; // attribute: zero crossing trigger on/off
+	double attr_minlength; // attribute: min grain length in ms
+	double attr_maxlength; // attribute: max grain length in ms
+	t_atom_long attr_sync; // attribute: internal scheduler (synchronous mode) on/off
+	double attr_density; // attribute: grain density of the internal scheduler in grains per second
+	double attr_jitter; // attribute: onset jitter of the internal scheduler (0 - 1, fraction of the inter-onset interval)
+	t_cmgrainlabs_index *index; // shared analysis index of the sample buffer
+	void *index_qelem; // qelem for updating the analysis index off the audio thread
+	struct _cmgrainlabs *index_next; // next instance sharing the same analysis index
+	t_critical match_lock; // lock for swapping the match list
+	t_int32 *match; // start positions (buffer samples, ascending) of all frames matching the selection attributes
+	long match_count; // number of entries in the match list
+	t_atom_long attr_select; // attribute: feature driven start selection on/off
+	double attr_rms[2]; // attribute: rms selection range (min/max)
+	double attr_centroid[2]; // attribute: spectral centroid selection range in Hz (min/max)
+	t_atom_long attr_onsets; // attribute: select onset frames only on/off
+	t_atom_long attr_snap; // attribute: snap grain start to the nearest upward zero crossing on/off
+	t_atom_long attr_precision; // attribute: internal math and accumulation precision (0 = float32, 1 = double)
 } t_cmgrainlabs;
 
 
+/************************************************************************************************************************/
+/* FLOATING POINT STATE (DENORMALS)                                                                                     */
+/************************************************************************************************************************/
+#if defined(__aarch64__)
+typedef unsigned long long t_cmgrainlabs_fpstate; // floating point control register (fpcr)
+#else
+typedef unsigned int t_cmgrainlabs_fpstate; // sse control and status register (mxcsr)
+#endif
+
+// disable denormals and return the previous floating point state
+static inline t_cmgrainlabs_fpstate cmgrainlabs_denormals_off(void) {
+	t_cmgrainlabs_fpstate state = 0;
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+	state = _mm_getcsr();
+	_mm_setcsr(state | 0x8040); // set flush to zero (bit 15) and denormals are zero (bit 6)
+#elif defined(__aarch64__)
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(state));
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(state | (1ULL << 24))); // set flush to zero (bit 24)
+#endif
+	return state;
+}
+
+// restore the floating point state returned by cmgrainlabs_denormals_off
+static inline void cmgrainlabs_denormals_restore(t_cmgrainlabs_fpstate state) {
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+	_mm_setcsr(state);
+#elif defined(__aarch64__)
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+#else
+	(void)state;
+#endif
+}
+
+
 /************************************************************************************************************************/
 /* STATIC DECLARATIONS                                                                                                  */
 /************************************************************************************************************************/
 static t_class *cmgrainlabs_class; // class pointer
 static t_symbol *ps_buffer_modified, *ps_stereo;
+static t_hashtab *cmgrainlabs_indexes; // analysis indexes shared by all instances, keyed by sample buffer name
+static double (*cmgrainlabs_random)(double *min, double *max) = cm_random; // random number source for all grain parameters (replaced by a seeded generator in the test harness)
 
 
 /************************************************************************************************************************/
@@ -101,6 +218,27 @@ t_max_err cmgrainlabs_stereo_set(t_cmgrainlabs *x, t_object *attr, long argc, t_
 t_max_err cmgrainlabs_winterp_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmgrainlabs_sinterp_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmgrainlabs_zero_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_minlength_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_maxlength_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_sync_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_density_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_jitter_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_select_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_rms_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_centroid_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_onsets_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_snap_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmgrainlabs_precision_set(t_cmgrainlabs *x, t_object *attr, long argc, t_atom *argv);
+static inline double cmgrainlabs_lininterp(double distance, float *buffer, long framecount, t_atom_long channelcount, short channel);
+static inline float cmgrainlabs_lininterp_f(long index, float frac, float *buffer, long framecount, t_atom_long channelcount, short channel);
+static inline void cmgrainlabs_prefetch(t_cmgrainlabs *x, long i, double from, double to, float *b_sample, long b_framecount, t_atom_long b_channelcount, long p_step);
+t_cmgrainlabs_index *cmgrainlabs_index_acquire(t_cmgrainlabs *x, t_symbol *name);
+void cmgrainlabs_index_release(t_cmgrainlabs *x, t_cmgrainlabs_index *index);
+void cmgrainlabs_index_build(t_cmgrainlabs_index *index, t_buffer_obj *buffer);
+void *cmgrainlabs_index_thread(t_cmgrainlabs_index *index);
+void cmgrainlabs_index_update(t_cmgrainlabs *x);
+void cmgrainlabs_fft(double *re, double *im, long n, double *tw_re, double *tw_im);
+long cmgrainlabs_lowerbound(t_int32 *array, long count, double value);
 
 
 /************************************************************************************************************************/
@@ -142,14 +280,91 @@ int C74_EXPORT main(void) {
 	CLASS_ATTR_SAVE(cmgrainlabs_class, "zero", 0);
 	CLASS_ATTR_STYLE_LABEL(cmgrainlabs_class, "zero", 0, "onoff", "Zero crossing trigger mode on/off");
 	
+	CLASS_ATTR_DOUBLE(cmgrainlabs_class, "minlength", 0, t_cmgrainlabs, attr_minlength);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "minlength", (method)NULL, (method)cmgrainlabs_minlength_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "minlength", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "minlength", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "minlength", 0, "Min grain length (ms)");
+	
+	CLASS_ATTR_DOUBLE(cmgrainlabs_class, "maxlength", 0, t_cmgrainlabs, attr_maxlength);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "maxlength", (method)NULL, (method)cmgrainlabs_maxlength_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "maxlength", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "maxlength", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "maxlength", 0, "Max grain length (ms)");
+	
+	CLASS_ATTR_ATOM_LONG(cmgrainlabs_class, "sync", 0, t_cmgrainlabs, attr_sync);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "sync", (method)NULL, (method)cmgrainlabs_sync_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "sync", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "sync", 0);
+	CLASS_ATTR_STYLE_LABEL(cmgrainlabs_class, "sync", 0, "onoff", "Internal scheduler on/off");
+	
+	CLASS_ATTR_DOUBLE(cmgrainlabs_class, "density", 0, t_cmgrainlabs, attr_density);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "density", (method)NULL, (method)cmgrainlabs_density_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "density", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "density", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "density", 0, "Grain density (grains/sec)");
+	
+	CLASS_ATTR_DOUBLE(cmgrainlabs_class, "jitter", 0, t_cmgrainlabs, attr_jitter);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "jitter", (method)NULL, (method)cmgrainlabs_jitter_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "jitter", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "jitter", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "jitter", 0, "Onset jitter (0 - 1)");
+	
+	CLASS_ATTR_ATOM_LONG(cmgrainlabs_class, "select", 0, t_cmgrainlabs, attr_select);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "select", (method)NULL, (method)cmgrainlabs_select_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "select", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "select", 0);
+	CLASS_ATTR_STYLE_LABEL(cmgrainlabs_class, "select", 0, "onoff", "Feature driven start selection on/off");
+	
+	CLASS_ATTR_DOUBLE_ARRAY(cmgrainlabs_class, "rms", 0, t_cmgrainlabs, attr_rms, 2);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "rms", (method)NULL, (method)cmgrainlabs_rms_set);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "rms", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "rms", 0, "RMS selection range (min/max)");
+	
+	CLASS_ATTR_DOUBLE_ARRAY(cmgrainlabs_class, "centroid", 0, t_cmgrainlabs, attr_centroid, 2);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "centroid", (method)NULL, (method)cmgrainlabs_centroid_set);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "centroid", 0);
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "centroid", 0, "Centroid selection range in Hz (min/max)");
+	
+	CLASS_ATTR_ATOM_LONG(cmgrainlabs_class, "onsets", 0, t_cmgrainlabs, attr_onsets);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "onsets", (method)NULL, (method)cmgrainlabs_onsets_set);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "onsets", 0);
+	CLASS_ATTR_STYLE_LABEL(cmgrainlabs_class, "onsets", 0, "onoff", "Select onset frames only");
+	
+	CLASS_ATTR_ATOM_LONG(cmgrainlabs_class, "snap", 0, t_cmgrainlabs, attr_snap);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "snap", (method)NULL, (method)cmgrainlabs_snap_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "snap", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "snap", 0);
+	CLASS_ATTR_STYLE_LABEL(cmgrainlabs_class, "snap", 0, "onoff", "Snap grain start to zero crossings on/off");
+	
+	CLASS_ATTR_ATOM_LONG(cmgrainlabs_class, "precision", 0, t_cmgrainlabs, attr_precision);
+	CLASS_ATTR_ACCESSORS(cmgrainlabs_class, "precision", (method)NULL, (method)cmgrainlabs_precision_set);
+	CLASS_ATTR_BASIC(cmgrainlabs_class, "precision", 0);
+	CLASS_ATTR_SAVE(cmgrainlabs_class, "precision", 0);
+	CLASS_ATTR_ENUMINDEX(cmgrainlabs_class, "precision", 0, "float32 double");
+	CLASS_ATTR_LABEL(cmgrainlabs_class, "precision", 0, "Internal precision");
+	
 	CLASS_ATTR_ORDER(cmgrainlabs_class, "stereo", 0, "1");
 	CLASS_ATTR_ORDER(cmgrainlabs_class, "w_interp", 0, "2");
 	CLASS_ATTR_ORDER(cmgrainlabs_class, "s_interp", 0, "3");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "minlength", 0, "4");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "maxlength", 0, "5");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "sync", 0, "6");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "density", 0, "7");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "jitter", 0, "8");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "select", 0, "9");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "rms", 0, "10");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "centroid", 0, "11");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "onsets", 0, "12");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "snap", 0, "13");
+	CLASS_ATTR_ORDER(cmgrainlabs_class, "precision", 0, "14");
 	
 	class_dspinit(cmgrainlabs_class); // Add standard Max/MSP methods to your class
 	class_register(CLASS_BOX, cmgrainlabs_class); // Register the class with Max
 	ps_buffer_modified = gensym("buffer_modified"); // assign the buffer modified message to the static pointer created above
 	ps_stereo = gensym("stereo");
+	cmgrainlabs_indexes = hashtab_new(0); // registry for the shared analysis indexes
+	hashtab_flags(cmgrainlabs_indexes, OBJ_FLAG_DATA); // the registry does not own (free) the stored indexes
 	return 0;
 }
 
@@ -175,6 +390,19 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 	object_attr_setlong(x, gensym("w_interp"), 0); // initialize window interpolation attribute
 	object_attr_setlong(x, gensym("s_interp"), 1); // initialize window interpolation attribute
 	object_attr_setlong(x, gensym("zero"), 0); // initialize zero crossing attribute
+	object_attr_setfloat(x, gensym("minlength"), DEFAULT_MINLENGTH); // initialize min grain length attribute
+	object_attr_setfloat(x, gensym("maxlength"), DEFAULT_MAXLENGTH); // initialize max grain length attribute
+	object_attr_setlong(x, gensym("sync"), 0); // initialize internal scheduler attribute
+	object_attr_setfloat(x, gensym("density"), 10.0); // initialize grain density attribute
+	object_attr_setfloat(x, gensym("jitter"), 0.0); // initialize onset jitter attribute
+	object_attr_setlong(x, gensym("select"), 0); // initialize feature selection attribute
+	x->attr_rms[0] = 0.0; // initialize rms selection range
+	x->attr_rms[1] = 1.0;
+	x->attr_centroid[0] = 0.0; // initialize centroid selection range
+	x->attr_centroid[1] = MAX_CENTROID;
+	object_attr_setlong(x, gensym("onsets"), 0); // initialize onset selection attribute
+	object_attr_setlong(x, gensym("snap"), 0); // initialize zero crossing snap attribute
+	object_attr_setlong(x, gensym("precision"), 0); // initialize precision attribute (float32)
 	attr_args_process(x, argc, argv); // get attribute values if supplied as argument
 	
 	// CHECK IF USER SUPPLIED MAXIMUM GRAINS IS IN THE LEGAL RANGE (1 - MAXGRAINS)
@@ -190,6 +418,8 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 	
 	// GET SYSTEM SAMPLE RATE
 	x->m_sr = sys_getsr() * 0.001; // get the current sample rate and write it into the object structure
+	x->m_sr_inv = x->m_sr > 0.0 ? 1.0 / x->m_sr : 0.0; // precompute milliseconds per sample
+	x->stream_frames = STREAM_GRAINLENGTH * x->m_sr; // precompute the streaming threshold in samples
 	
 	/************************************************************************************************************************/
 	// ALLOCATE MEMORY FOR THE BUSY ARRAY
@@ -200,33 +430,61 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 	}
 	
 	// ALLOCATE MEMORY FOR THE GRAINPOS ARRAY
-	x->grainpos = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long *));
+	x->grainpos = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double));
 	if (x->grainpos == NULL) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
 	
+	// ALLOCATE MEMORY FOR THE GRAINSTEP ARRAY
+	x->grainstep = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double));
+	if (x->grainstep == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
 	// ALLOCATE MEMORY FOR THE START ARRAY
-	x->start = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long *));
+	x->start = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double));
 	if (x->start == NULL) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
 	
 	// ALLOCATE MEMORY FOR THE T_LENGTH ARRAY
-	x->t_length = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long *));
+	x->t_length = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double));
 	if (x->t_length == NULL) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
 	
 	// ALLOCATE MEMORY FOR THE GR_LENGTH ARRAY
-	x->gr_length = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long *));
+	x->gr_length = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double));
 	if (x->gr_length == NULL) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
 	
+	// ALLOCATE MEMORY FOR THE REMAINING ARRAY
+	x->remaining = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long));
+	if (x->remaining == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
+	// ALLOCATE MEMORY FOR THE STREAMING ARRAY
+	x->streaming = (short *)sysmem_newptrclear((MAXGRAINS) * sizeof(short));
+	if (x->streaming == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
+	// ALLOCATE MEMORY FOR THE PREFETCHPOS ARRAY
+	x->prefetchpos = (long *)sysmem_newptrclear((MAXGRAINS) * sizeof(long));
+	if (x->prefetchpos == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
 	// ALLOCATE MEMORY FOR THE PAN_LEFT ARRAY
 	x->pan_left = (double *)sysmem_newptrclear((MAXGRAINS) * sizeof(double *));
 	if (x->pan_left == NULL) {
@@ -240,6 +498,34 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
+	
+	// ALLOCATE MEMORY FOR THE F_PAN_LEFT ARRAY
+	x->f_pan_left = (float *)sysmem_newptrclear((MAXGRAINS) * sizeof(float));
+	if (x->f_pan_left == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
+	// ALLOCATE MEMORY FOR THE F_PAN_RIGHT ARRAY
+	x->f_pan_right = (float *)sysmem_newptrclear((MAXGRAINS) * sizeof(float));
+	if (x->f_pan_right == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
+	// ALLOCATE MEMORY FOR THE F_WPOS ARRAY
+	x->f_wpos = (float *)sysmem_newptrclear((MAXGRAINS) * sizeof(float));
+	if (x->f_wpos == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
+	
+	// ALLOCATE MEMORY FOR THE F_WSTEP ARRAY
+	x->f_wstep = (float *)sysmem_newptrclear((MAXGRAINS) * sizeof(float));
+	if (x->f_wstep == NULL) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
+	}
 		
 	/************************************************************************************************************************/
 	// INITIALIZE VALUES
@@ -252,6 +538,9 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 	x->panmin_float = 0.0; // initialize value for min pan
 	x->panmax_float = 0.0; // initialize value for max pan
 	x->tr_prev = 0.0; // initialize value for previous trigger sample
+	x->next_onset = 0.0; // initialize the internal scheduler onset time
+	x->onsets = NULL; // the onset list is allocated in the dsp method according to the vector size
+	x->onsets_size = 0;
 	x->grains_count = 0; // initialize the grains count value
 	x->grains_limit_old = 0; // initialize value for the routine when grains limit was modified
 	x->limit_modified = 0; // initialize channel change flag
@@ -262,6 +551,15 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 	x->buffer = buffer_ref_new((t_object *)x, x->buffer_name); // write the buffer reference into the object structure
 	x->w_buffer = buffer_ref_new((t_object *)x, x->window_name); // write the window buffer reference into the object structure
 	
+	/************************************************************************************************************************/
+	// ANALYSIS INDEX (ACQUIRED AFTER ALL CHECKS THAT CAN FAIL, SO A FAILED INSTANCE NEVER JOINS THE SHARED USER LIST)
+	critical_new(&x->match_lock);
+	x->match = NULL;
+	x->match_count = 0;
+	x->index_qelem = qelem_new((t_object *)x, (method)cmgrainlabs_index_update); // the selection setters above skip the qelem while it is NULL
+	x->index = cmgrainlabs_index_acquire(x, x->buffer_name); // get the index shared by all instances using the same buffer
+	qelem_set(x->index_qelem); // analyse the sample buffer if select or snap are on (or pick up the existing shared analysis)
+	
 	return x;
 }
 
@@ -270,6 +568,14 @@ void *cmgrainlabs_new(t_symbol *s, long argc, t_atom *argv) {
 /* THE 64 BIT DSP METHOD                                                                                                */
 /************************************************************************************************************************/
 void cmgrainlabs_dsp64(t_cmgrainlabs *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
+	long i; // for loop counter
+	double ratio; // ratio between new and old sample rate
+	double position; // current read position of a grain in the sample buffer
+	double span; // remaining source span of a grain in samples
+	long b_framecount = 0; // number of frames in the sample buffer
+	long onsets_size; // required size of the scheduler onset list
+	t_buffer_obj *buffer = buffer_ref_getobject(x->buffer);
+	
 	x->connect_status[0] = count[1]; // 2nd inlet: write connection flag into object structure (1 if signal connected)
 	x->connect_status[1] = count[2]; // 3rd inlet: write connection flag into object structure (1 if signal connected)
 	x->connect_status[2] = count[3]; // 4th inlet: write connection flag into object structure (1 if signal connected)
@@ -280,9 +586,53 @@ void cmgrainlabs_dsp64(t_cmgrainlabs *x, t_object *dsp64, short *count, double s
 	x->connect_status[7] = count[8]; // 9th inlet: write connection flag into object structure (1 if signal connected)
 	
 	if (x->m_sr != samplerate * 0.001) { // check if sample rate stored in object structure is the same as the current project sample rate
+		ratio = x->m_sr > 0.0 ? (samplerate * 0.001) / x->m_sr : 1.0;
 		x->m_sr = samplerate * 0.001;
+		x->m_sr_inv = 1.0 / x->m_sr;
+		x->stream_frames = STREAM_GRAINLENGTH * x->m_sr;
+		if (buffer) {
+			b_framecount = buffer_getframecount(buffer);
+		}
+		// RESCALE ACTIVE GRAINS: DURATION AND POSITION ARE RATE INDEPENDENT, THE INCREMENT AND THE SOURCE SPAN ARE NOT
+		for (i = 0; i < MAXGRAINS; i++) {
+			if (x->busy[i]) {
+				position = x->start[i] + x->grainpos[i] * x->gr_length[i];
+				x->gr_length[i] *= ratio; // keep the pitch (source samples per output sample) unchanged
+				span = (1.0 - x->grainpos[i]) * x->gr_length[i]; // source samples still to be read
+				if (span > b_framecount && x->grainpos[i] < 1.0) { // as at grain start: never read more than the whole buffer (lowers the pitch)
+					x->gr_length[i] = b_framecount / (1.0 - x->grainpos[i]);
+					span = b_framecount;
+				}
+				if (position + span > b_framecount) { // the rest no longer fits into the buffer: move the read position back, the window plays on
+					position = b_framecount - span;
+				}
+				x->start[i] = position - x->grainpos[i] * x->gr_length[i]; // re-anchor on the read position (continuous unless it was moved back)
+				x->prefetchpos[i] = (long)position;
+				x->grainstep[i] = x->m_sr_inv / x->t_length[i];
+				x->remaining[i] = (long)ceil((1.0 - x->grainpos[i]) * x->t_length[i] * x->m_sr - COUNT_TOLERANCE); // the rest of the duration in samples at the new rate
+				if (x->remaining[i] < 1) {
+					x->remaining[i] = 1;
+				}
+				x->f_wstep[i] /= (float)ratio; // the window increment scales like the normalized increment
+			}
+		}
 	}
 	
+	// ALLOCATE MEMORY FOR THE INTERNAL SCHEDULER ONSET LIST
+	// the shortest possible interval is MIN_ONSET_INTERVAL periods at MAX_DENSITY, so the list can hold every onset of a vector
+	onsets_size = (long)ceil(maxvectorsize * MAX_DENSITY / (samplerate * MIN_ONSET_INTERVAL)) + 1;
+	if (x->onsets_size < onsets_size) {
+		if (x->onsets) {
+			sysmem_freeptr(x->onsets);
+		}
+		x->onsets = (double *)sysmem_newptrclear(onsets_size * sizeof(double));
+		x->onsets_size = x->onsets ? onsets_size : 0;
+		if (x->onsets == NULL) {
+			object_error((t_object *)x, "out of memory");
+		}
+	}
+	x->next_onset = 0.0; // first scheduled grain starts with the first sample after dsp restart
+	
 	// CALL THE PERFORM ROUTINE
 	//object_method(dsp64, gensym("dsp_add64"), x, cmgrainlabs_perform64, 0, NULL);
 	dsp_add64(dsp64, (t_object*)x, (t_perfroutine64)cmgrainlabs_perform64, 0, NULL);
@@ -297,14 +647,29 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 	short trigger = 0; // trigger occurred yes/no
 	long i, limit; // for loop counterS
 	long n = sampleframes; // number of samples per signal vector
+	long frame; // index of the current sample within the signal vector
 	double tr_curr; // current trigger value
+	double offset = 0.0; // sub-sample offset of a scheduled grain onset (0 - 1 samples)
+	double period, interval, jmin, jmax; // internal scheduler inter-onset interval in samples
+	long o_count = 0; // number of onsets scheduled for the current signal vector
+	long o_index = 0; // index of the next onset to be processed
 	double pan; // temporary random pan information
 	double pitch; // temporary pitch for new grains
+	double length; // temporary grain duration in ms for new grains
 	double distance; // floating point index for reading from buffers
 	long index; // truncated index for reading from buffers
+	short selected; // checkflag if the start position was picked from the analysis index
+	long crossing; // index into the zero crossing index
+	double r_min, r_max; // range of matching frames within the start range
 	double w_read, b_read; // current sample read from the window buffer
 	double outsample_left = 0.0; // temporary left output sample used for adding up all grain samples
 	double outsample_right = 0.0; // temporary right output sample used for adding up all grain samples
+	float f_outsample_left = 0.0f; // temporary left output sample for the float32 precision mode
+	float f_outsample_right = 0.0f; // temporary right output sample for the float32 precision mode
+	float f_w_read, f_b_read; // window and buffer samples for the float32 precision mode
+	float f_frac; // fractional part of the buffer read position for the float32 precision mode
+	t_atom_long precision = x->attr_precision; // precision mode for the whole signal vector
+	t_cmgrainlabs_fpstate fp_state; // floating point control register state before the perform routine
 	int slot = 0; // variable for the current slot in the arrays to write grain info to
 	cm_panstruct panstruct; // struct for holding the calculated constant power left and right stereo values
 	
@@ -321,6 +686,10 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 	long w_framecount; // number of frames in the window buffer
 	t_atom_long b_channelcount; // number of channels in the sample buffer
 	t_atom_long w_channelcount; // number of channels in the window buffer
+	long p_step; // number of frames per cache line (64 bytes = 16 floats) for the streaming read path
+	
+	// DISABLE DENORMALS FOR THE DURATION OF THE PERFORM ROUTINE (DECAYING WINDOW TAILS WOULD OTHERWISE GO SUBNORMAL)
+	fp_state = cmgrainlabs_denormals_off();
 	
 	// BUFFER CHECKS
 	if (!b_sample) { // if the sample buffer does not exist
@@ -335,31 +704,81 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 	w_framecount = buffer_getframecount(w_buffer); // get number of frames in the window buffer
 	b_channelcount = buffer_getchannelcount(buffer); // get number of channels in the sample buffer
 	w_channelcount = buffer_getchannelcount(w_buffer); // get number of channels in the sample buffer
+	p_step = (b_channelcount < 16) ? 16 / b_channelcount : 1; // frames per cache line
+	
+	// FLOAT32 PRECISION MODE: RE-ANCHOR THE WINDOW POSITIONS ON THE DOUBLE GRAIN POSITIONS ONCE PER SIGNAL VECTOR
+	// (bounds the single precision accumulation drift of long grains and picks up grains started in double mode)
+	if (!precision) {
+		for (i = 0; i < MAXGRAINS; i++) {
+			if (x->busy[i]) {
+				x->f_wpos[i] = (float)(x->grainpos[i] * (double)w_framecount);
+			}
+		}
+	}
 		
+	// STREAMING READ PATH: ONCE PER SIGNAL VECTOR, PREFETCH WHAT LONG GRAINS READ IN THIS VECTOR PLUS PREFETCH_FRAMES AHEAD
+	for (i = 0; i < MAXGRAINS; i++) {
+		if (x->busy[i] && x->streaming[i]) {
+			distance = x->start[i] + x->grainpos[i] * x->gr_length[i];
+			cmgrainlabs_prefetch(x, i, distance, distance + x->grainstep[i] * sampleframes * x->gr_length[i] + PREFETCH_FRAMES, b_sample, b_framecount, b_channelcount, p_step);
+		}
+	}
+	
 	// GET INLET VALUES
 	t_double *tr_sigin 	= (t_double *)ins[0]; // get trigger input signal from 1st inlet
 	t_double startmin 	= x->connect_status[0]? *ins[1] * x->m_sr : x->startmin_float * x->m_sr; // get start min input signal from 2nd inlet
 	t_double startmax 	= x->connect_status[1]? *ins[2] * x->m_sr : x->startmax_float * x->m_sr; // get start max input signal from 3rd inlet
-	t_double lengthmin 	= x->connect_status[2]? *ins[3] * x->m_sr : x->lengthmin_float * x->m_sr; // get grain min length input signal from 4th inlet
-	t_double lengthmax 	= x->connect_status[3]? *ins[4] * x->m_sr : x->lengthmax_float * x->m_sr; // get grain max length input signal from 5th inlet
+	t_double lengthmin 	= x->connect_status[2]? *ins[3] : x->lengthmin_float; // get grain min length (ms) input signal from 4th inlet
+	t_double lengthmax 	= x->connect_status[3]? *ins[4] : x->lengthmax_float; // get grain max length (ms) input signal from 5th inlet
 	t_double pitchmin 	= x->connect_status[4]? *ins[5] : x->pitchmin_float; // get pitch min input signal from 6th inlet
 	t_double pitchmax 	= x->connect_status[5]? *ins[6] : x->pitchmax_float; // get pitch max input signal from 7th inlet
 	t_double panmin 	= x->connect_status[6]? *ins[7] : x->panmin_float; // get min pan input signal from 8th inlet
 	t_double panmax 	= x->connect_status[7]? *ins[8] : x->panmax_float; // get max pan input signal from 8th inlet
 	
+	// INTERNAL SCHEDULER: COMPUTE ALL GRAIN ONSETS FOR THIS SIGNAL VECTOR AHEAD OF THE DSP LOOP
+	if (x->attr_sync && x->onsets) {
+		period = (x->m_sr * 1000.0) / x->attr_density; // inter-onset interval in samples
+		jmin = period * ((1.0 - x->attr_jitter) > MIN_ONSET_INTERVAL ? (1.0 - x->attr_jitter) : MIN_ONSET_INTERVAL);
+		jmax = period * (1.0 + x->attr_jitter);
+		while (x->next_onset < sampleframes) {
+			if (o_count < x->onsets_size) { // the list is sized for the worst case in the dsp method, this is only a safety guard
+				x->onsets[o_count++] = x->next_onset;
+			}
+			if (x->attr_jitter > 0.0) {
+				interval = cmgrainlabs_random(&jmin, &jmax);
+			}
+			else {
+				interval = period;
+			}
+			x->next_onset += interval;
+		}
+		x->next_onset -= sampleframes; // make the next onset relative to the start of the next signal vector
+	}
+	
 	// DSP LOOP
 	while (n--) {
-		tr_curr = *tr_sigin++; // get current trigger value
+		frame = sampleframes - 1 - n;
 		
-		if (x->attr_zero) {
-			if (tr_curr > 0.0 && x->tr_prev < 0.0) { // zero crossing from negative to positive
+		if (x->attr_sync) {
+			if (o_index < o_count && x->onsets[o_index] <= frame) { // a scheduled onset falls within the current sample
 				trigger = 1;
+				offset = frame - x->onsets[o_index++];
 			}
 		}
 		else {
-			if ((x->tr_prev - tr_curr) > 0.9) {
-				trigger = 1;
+			tr_curr = *tr_sigin++; // get current trigger value
+			
+			if (x->attr_zero) {
+				if (tr_curr > 0.0 && x->tr_prev < 0.0) { // zero crossing from negative to positive
+					trigger = 1;
+				}
 			}
+			else {
+				if ((x->tr_prev - tr_curr) > 0.9) {
+					trigger = 1;
+				}
+			}
+			x->tr_prev = tr_curr; // store current trigger value in object structure
 		}
 		
 		if (x->buffer_modified) { // reset all playback information when any of the buffers was modified
@@ -371,7 +790,7 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 		}
 		/************************************************************************************************************************/
 		// IN CASE OF TRIGGER, LIMIT NOT MODIFIED AND GRAINS COUNT IN THE LEGAL RANGE (AVAILABLE SLOTS)
-		if (trigger && x->grains_count < x->grains_limit && !x->limit_modified) { // based on zero crossing --> when ramp from 0-1 restarts.
+		while (trigger && x->grains_count < x->grains_limit && !x->limit_modified) { // based on zero crossing --> when ramp from 0-1 restarts.
 			trigger = 0; // reset trigger
 			x->grains_count++; // increment grains_count
 			// FIND A FREE SLOT FOR THE NEW GRAIN
@@ -386,31 +805,58 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 			}
 			/************************************************************************************************************************/
 			// GET RANDOM START POSITION
-			if (startmin != startmax) { // only call random function when min and max values are not the same!
-				x->start[slot] = (long)cm_random(&startmin, &startmax);
+			selected = 0;
+			if (x->attr_select && critical_tryenter(x->match_lock) == MAX_ERR_NONE) { // pick a random matching analysis frame within the start range (binary search), skipped while the list is swapped
+				if (x->match_count) {
+					r_min = cmgrainlabs_lowerbound(x->match, x->match_count, startmin < startmax ? startmin : startmax);
+					r_max = cmgrainlabs_lowerbound(x->match, x->match_count, startmin < startmax ? startmax : startmin);
+					if (r_max > r_min) {
+						index = (long)cmgrainlabs_random(&r_min, &r_max);
+						if (index >= r_max) {
+							index = r_max - 1;
+						}
+						x->start[slot] = x->match[index];
+						selected = 1;
+					}
+				}
+				critical_exit(x->match_lock);
 			}
-			else {
-				x->start[slot] = startmin;
+			if (!selected) { // no feature selection or no matching frame in range: uniform random start
+				if (startmin != startmax) { // only call random function when min and max values are not the same!
+					x->start[slot] = (long)cmgrainlabs_random(&startmin, &startmax);
+				}
+				else {
+					x->start[slot] = startmin;
+				}
 			}
 			/************************************************************************************************************************/
 			// GET RANDOM LENGTH
 			if (lengthmin != lengthmax) { // only call random function when min and max values are not the same!
-				x->t_length[slot] = (long)cm_random(&lengthmin, &lengthmax);
+				length = cmgrainlabs_random(&lengthmin, &lengthmax);
 			}
 			else {
-				x->t_length[slot] = lengthmin;
+				length = lengthmin;
+			}
+			// CHECK IF THE VALUE FOR PERCEPTIBLE GRAIN LENGTH IS LEGAL (IN MS, NO TRUNCATION TO SAMPLES)
+			if (length > x->attr_maxlength) { // if grain length is larger than the max grain length
+				length = x->attr_maxlength; // set grain length to max grain length
 			}
-			// CHECK IF THE VALUE FOR PERCEPTIBLE GRAIN LENGTH IS LEGAL
-			if (x->t_length[slot] > MAX_GRAINLENGTH * x->m_sr) { // if grain length is larger than the max grain length
-				x->t_length[slot] = MAX_GRAINLENGTH * x->m_sr; // set grain length to max grain length
+			else if (length < x->attr_minlength) { // if grain length is samller than the min grain length
+				length = x->attr_minlength; // set grain length to min grain length
 			}
-			else if (x->t_length[slot] < MIN_GRAINLENGTH * x->m_sr) { // if grain length is samller than the min grain length
-				x->t_length[slot] = MIN_GRAINLENGTH * x->m_sr; // set grain length to min grain length
+			x->t_length[slot] = length;
+			x->grainstep[slot] = x->m_sr_inv / length; // normalized position increment per output sample
+			x->grainpos[slot] = offset * x->grainstep[slot]; // advance the grain by the sub-sample onset offset
+			x->remaining[slot] = (long)ceil(length * x->m_sr - offset - COUNT_TOLERANCE); // whole output samples until the end position (the accumulated position may round past it)
+			if (x->remaining[slot] < 1) {
+				x->remaining[slot] = 1;
 			}
+			x->f_wstep[slot] = (float)(x->grainstep[slot] * (double)w_framecount); // window state for the float32 precision mode
+			x->f_wpos[slot] = (float)(x->grainpos[slot] * (double)w_framecount);
 			/************************************************************************************************************************/
 			// GET RANDOM PAN
 			if (panmin != panmax) { // only call random function when min and max values are not the same!
-				pan = cm_random(&panmin, &panmax);
+				pan = cmgrainlabs_random(&panmin, &panmax);
 			}
 			else {
 				pan = panmin;
@@ -425,10 +871,12 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 			cm_panning(&panstruct, &pan); // calculate pan values in panstruct
 			x->pan_left[slot] = panstruct.left;
 			x->pan_right[slot] = panstruct.right;
+			x->f_pan_left[slot] = (float)panstruct.left;
+			x->f_pan_right[slot] = (float)panstruct.right;
 			/************************************************************************************************************************/
 			// GET RANDOM PITCH
 			if (pitchmin != pitchmax) { // only call random function when min and max values are not the same!
-				pitch = cm_random(&pitchmin, &pitchmax);
+				pitch = cmgrainlabs_random(&pitchmin, &pitchmax);
 			}
 			else {
 				pitch = pitchmin;
@@ -442,7 +890,7 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 			}
 			/************************************************************************************************************************/
 			// CALCULATE THE ACTUAL GRAIN LENGTH (SAMPLES) ACCORDING TO PITCH
-			x->gr_length[slot] = x->t_length[slot] * pitch;
+			x->gr_length[slot] = x->t_length[slot] * x->m_sr * pitch;
 			// CHECK THAT GRAIN LENGTH IS NOT LARGER THAN SIZE OF BUFFER
 			if (x->gr_length[slot] > b_framecount) {
 				x->gr_length[slot] = b_framecount;
@@ -450,11 +898,47 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 			/************************************************************************************************************************/
 			// CHECK IF START POSITION IS LEGAL ACCORDING TO GRAINzLENGTH (SAMPLES) AND BUFFER SIZE
 			if (x->start[slot] > b_framecount - x->gr_length[slot]) {
-				x->start[slot] = b_framecount - x->gr_length[slot];
+				x->start[slot] = (long)(b_framecount - x->gr_length[slot]); // keep start positions on whole samples
 			}
 			if (x->start[slot] < 0) {
 				x->start[slot] = 0;
 			}
+			/************************************************************************************************************************/
+			// SNAP START POSITION TO THE NEAREST UPWARD ZERO CROSSING (BINARY SEARCH IN THE CROSSING INDEX)
+			if (x->attr_snap && critical_tryenter(x->match_lock) == MAX_ERR_NONE) { // the index pointer is only swapped under this lock
+				if (x->index && critical_tryenter(x->index->lock) == MAX_ERR_NONE) { // never wait on the audio thread: the grain keeps its unsnapped start while the index is busy
+					if (x->index->crossingcount) {
+						crossing = cmgrainlabs_lowerbound(x->index->crossings, x->index->crossingcount, x->start[slot]);
+						if (crossing >= x->index->crossingcount || (crossing > 0 && x->start[slot] - x->index->crossings[crossing - 1] < x->index->crossings[crossing] - x->start[slot])) {
+							crossing--; // previous crossing is nearer
+						}
+						if (crossing > 0 && x->index->crossings[crossing] > b_framecount - x->gr_length[slot]) {
+							crossing--; // grain would run past the end of the buffer
+						}
+						if (x->index->crossings[crossing] <= b_framecount - x->gr_length[slot]) {
+							x->start[slot] = x->index->crossings[crossing];
+						}
+					}
+					critical_exit(x->index->lock);
+				}
+				critical_exit(x->match_lock);
+			}
+			/************************************************************************************************************************/
+			// LONG GRAINS ARE READ SEQUENTIALLY WITH PREFETCHING AHEAD OF THE READ HEAD
+			x->streaming[slot] = (x->gr_length[slot] > x->stream_frames); // decided by the source span, not the output duration
+			x->prefetchpos[slot] = (long)x->start[slot];
+			/************************************************************************************************************************/
+			// INTERNAL SCHEDULER: MORE THAN ONE ONSET CAN FALL WITHIN THE SAME SAMPLE
+			if (x->attr_sync && o_index < o_count && x->onsets[o_index] <= frame) {
+				trigger = 1;
+				offset = frame - x->onsets[o_index++];
+			}
+		}
+		if (x->attr_sync) { // scheduled onsets that found no free slot are dropped
+			while (o_index < o_count && x->onsets[o_index] <= frame) {
+				o_index++;
+			}
+			trigger = 0;
 		}
 		/************************************************************************************************************************/
 		// CONTINUE WITH THE PLAYBACK ROUTINE
@@ -477,53 +961,124 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 			else {
 				limit = x->grains_limit;
 			}
-			for (i = 0; i < limit; i++) {
-				if (x->busy[i]) { // if the current slot contains grain playback information
-					// GET WINDOW SAMPLE FROM WINDOW BUFFER
-					if (x->attr_winterp) {
-						distance = ((double)x->grainpos[i] / (double)x->t_length[i]) * (double)w_framecount;
-						w_read = cm_lininterp(distance, w_sample, w_channelcount, 0);
-					}
-					else {
-						index = (long)(((double)x->grainpos[i] / (double)x->t_length[i]) * (double)w_framecount);
-						w_read = w_sample[index];
-					}
-					// GET GRAIN SAMPLE FROM SAMPLE BUFFER
-					distance = x->start[i] + (((double)x->grainpos[i]++ / (double)x->t_length[i]) * (double)x->gr_length[i]);
-					
-					if (b_channelcount > 1 && x->attr_stereo) { // if more than one channel
-						if (x->attr_sinterp) {
-							outsample_left += (cm_lininterp(distance, b_sample, b_channelcount, 0) * w_read) * x->pan_left[i]; // get interpolated sample
-							outsample_right += (cm_lininterp(distance, b_sample, b_channelcount, 1) * w_read) * x->pan_right[i];
+			if (precision) { // double precision mode
+				for (i = 0; i < limit; i++) {
+					if (x->busy[i]) { // if the current slot contains grain playback information
+						// GET WINDOW SAMPLE FROM WINDOW BUFFER
+						if (x->attr_winterp) {
+							distance = x->grainpos[i] * (double)w_framecount;
+							w_read = cmgrainlabs_lininterp(distance, w_sample, w_framecount, w_channelcount, 0);
 						}
 						else {
-							outsample_left += (b_sample[(long)distance * b_channelcount] * w_read) * x->pan_left[i];
-							outsample_right += (b_sample[((long)distance * b_channelcount) + 1] * w_read) * x->pan_right[i];
+							index = (long)(x->grainpos[i] * (double)w_framecount);
+							if (index >= w_framecount) { // rounding of the accumulated position can reach the end of the window
+								index = w_framecount - 1;
+							}
+							w_read = w_sample[index];
 						}
-					}
-					else {
-						if (x->attr_sinterp) {
-							b_read = cm_lininterp(distance, b_sample, b_channelcount, 0) * w_read; // get interpolated sample
-							outsample_left += b_read * x->pan_left[i];
-							outsample_right += b_read * x->pan_right[i];
+						// GET GRAIN SAMPLE FROM SAMPLE BUFFER
+						distance = x->start[i] + (x->grainpos[i] * x->gr_length[i]);
+						x->grainpos[i] += x->grainstep[i]; // advance the normalized playback position
+						
+						index = (long)distance;
+						if (index >= b_framecount) { // rounding of the accumulated position can reach the end of the buffer
+							index = b_framecount - 1;
+						}
+						if (b_channelcount > 1 && x->attr_stereo) { // if more than one channel
+							if (x->attr_sinterp) {
+								outsample_left += (cmgrainlabs_lininterp(distance, b_sample, b_framecount, b_channelcount, 0) * w_read) * x->pan_left[i]; // get interpolated sample
+								outsample_right += (cmgrainlabs_lininterp(distance, b_sample, b_framecount, b_channelcount, 1) * w_read) * x->pan_right[i];
+							}
+							else {
+								outsample_left += (b_sample[index * b_channelcount] * w_read) * x->pan_left[i];
+								outsample_right += (b_sample[(index * b_channelcount) + 1] * w_read) * x->pan_right[i];
+							}
 						}
 						else {
-							outsample_left += (b_sample[(long)distance * b_channelcount] * w_read) * x->pan_left[i];
-							outsample_right += (b_sample[(long)distance * b_channelcount] * w_read) * x->pan_right[i];
+							if (x->attr_sinterp) {
+								b_read = cmgrainlabs_lininterp(distance, b_sample, b_framecount, b_channelcount, 0) * w_read; // get interpolated sample
+								outsample_left += b_read * x->pan_left[i];
+								outsample_right += b_read * x->pan_right[i];
+							}
+							else {
+								outsample_left += (b_sample[index * b_channelcount] * w_read) * x->pan_left[i];
+								outsample_right += (b_sample[index * b_channelcount] * w_read) * x->pan_right[i];
+							}
+						}
+						if (--x->remaining[i] <= 0) { // if current grain has played all of its samples
+							x->grainpos[i] = 0.0; // reset parameters for overwrite
+							x->busy[i] = 0;
+							x->grains_count--;
+							if (x->grains_count < 0) {
+								x->grains_count = 0;
+							}
 						}
 					}
-					if (x->grainpos[i] == x->t_length[i]) { // if current grain has reached the end position
-						x->grainpos[i] = 0; // reset parameters for overwrite
-						x->busy[i] = 0;
-						x->grains_count--;
-						if (x->grains_count < 0) {
-							x->grains_count = 0;
+				}
+				*out_left++ = outsample_left; // write added sample values to left output vector
+				*out_right++ = outsample_right; // write added sample values to right output vector
+			}
+			else { // float32 precision mode: window state, pan gains and accumulation in float, buffer positions stay double
+				for (i = 0; i < limit; i++) {
+					if (x->busy[i]) { // if the current slot contains grain playback information
+						// GET WINDOW SAMPLE FROM WINDOW BUFFER
+						if (x->attr_winterp) {
+							index = (long)x->f_wpos[i];
+							if (index >= w_framecount) { // single precision rounding can reach the end of the window
+								index = w_framecount - 1;
+							}
+							f_w_read = cmgrainlabs_lininterp_f(index, x->f_wpos[i] - (float)index, w_sample, w_framecount, w_channelcount, 0);
+							x->f_wpos[i] += x->f_wstep[i]; // advance the window position
+						}
+						else { // truncated lookup from the double position: a rounding error must not select the neighbouring window sample
+							index = (long)(x->grainpos[i] * (double)w_framecount);
+							if (index >= w_framecount) {
+								index = w_framecount - 1;
+							}
+							f_w_read = w_sample[index];
+						}
+						// GET GRAIN SAMPLE FROM SAMPLE BUFFER
+						distance = x->start[i] + (x->grainpos[i] * x->gr_length[i]);
+						x->grainpos[i] += x->grainstep[i]; // advance the normalized playback position
+						
+						index = (long)distance;
+						if (index >= b_framecount) {
+							index = b_framecount - 1;
+						}
+						if (b_channelcount > 1 && x->attr_stereo) { // if more than one channel
+							if (x->attr_sinterp) {
+								f_frac = (float)(distance - index);
+								f_outsample_left += (cmgrainlabs_lininterp_f(index, f_frac, b_sample, b_framecount, b_channelcount, 0) * f_w_read) * x->f_pan_left[i];
+								f_outsample_right += (cmgrainlabs_lininterp_f(index, f_frac, b_sample, b_framecount, b_channelcount, 1) * f_w_read) * x->f_pan_right[i];
+							}
+							else {
+								f_outsample_left += (b_sample[index * b_channelcount] * f_w_read) * x->f_pan_left[i];
+								f_outsample_right += (b_sample[(index * b_channelcount) + 1] * f_w_read) * x->f_pan_right[i];
+							}
+						}
+						else {
+							if (x->attr_sinterp) {
+								f_b_read = cmgrainlabs_lininterp_f(index, (float)(distance - index), b_sample, b_framecount, b_channelcount, 0) * f_w_read;
+							}
+							else {
+								f_b_read = b_sample[index * b_channelcount] * f_w_read;
+							}
+							f_outsample_left += f_b_read * x->f_pan_left[i];
+							f_outsample_right += f_b_read * x->f_pan_right[i];
+						}
+						if (--x->remaining[i] <= 0) { // if current grain has played all of its samples
+							x->grainpos[i] = 0.0; // reset parameters for overwrite
+							x->busy[i] = 0;
+							x->grains_count--;
+							if (x->grains_count < 0) {
+								x->grains_count = 0;
+							}
 						}
 					}
 				}
+				*out_left++ = f_outsample_left; // write added sample values to left output vector (the signal chain is 64 bit)
+				*out_right++ = f_outsample_right; // write added sample values to right output vector
 			}
-			*out_left++ = outsample_left; // write added sample values to left output vector
-			*out_right++ = outsample_right; // write added sample values to right output vector
 		}
 		// CHECK IF GRAINS COUNT IS ZERO, THEN RESET LIMIT_MODIFIED CHECKFLAG
 		if (x->grains_count == 0) {
@@ -531,15 +1086,17 @@ void cmgrainlabs_perform64(t_cmgrainlabs *x, t_object *dsp64, double **ins, long
 		}
 		
 		/************************************************************************************************************************/
-		x->tr_prev = tr_curr; // store current trigger value in object structure
 		outsample_left = 0.0;
 		outsample_right = 0.0;
+		f_outsample_left = 0.0f;
+		f_outsample_right = 0.0f;
 	}
 	
 	/************************************************************************************************************************/
 	// STORE UPDATED RUNNING VALUES INTO THE OBJECT STRUCTURE
 	buffer_unlocksamples(buffer);
 	buffer_unlocksamples(w_buffer);
+	cmgrainlabs_denormals_restore(fp_state); // restore the caller's floating point state before calling back into max
 	outlet_int(x->grains_count_out, x->grains_count); // send number of currently playing grains to the outlet
 	return;
 	
@@ -550,6 +1107,7 @@ zero:
 	}
 	buffer_unlocksamples(buffer);
 	buffer_unlocksamples(w_buffer);
+	cmgrainlabs_denormals_restore(fp_state);
 }
 
 
@@ -614,11 +1172,28 @@ void cmgrainlabs_free(t_cmgrainlabs *x) {
 	
 	sysmem_freeptr(x->busy); // free memory allocated to the busy array
 	sysmem_freeptr(x->grainpos); // free memory allocated to the grainpos array
+	sysmem_freeptr(x->grainstep); // free memory allocated to the grainstep array
 	sysmem_freeptr(x->start); // free memory allocated to the start array
 	sysmem_freeptr(x->t_length); // free memory allocated to the t_length array
 	sysmem_freeptr(x->gr_length); // free memory allocated to the t_length array
+	sysmem_freeptr(x->remaining); // free memory allocated to the remaining array
+	sysmem_freeptr(x->streaming); // free memory allocated to the streaming array
+	sysmem_freeptr(x->prefetchpos); // free memory allocated to the prefetchpos array
+	cmgrainlabs_index_release(x, x->index); // release the shared analysis index (the analysis thread no longer sees the qelem)
+	qelem_free(x->index_qelem); // free the index update qelem
+	if (x->match) {
+		sysmem_freeptr(x->match); // free memory allocated to the match list
+	}
+	critical_free(x->match_lock);
+	if (x->onsets) {
+		sysmem_freeptr(x->onsets); // free memory allocated to the onsets array
+	}
 	sysmem_freeptr(x->pan_left); // free memory allocated to the pan_left array
 	sysmem_freeptr(x->pan_right); // free memory allocated to the pan_right array
+	sysmem_freeptr(x->f_pan_left); // free memory allocated to the f_pan_left array
+	sysmem_freeptr(x->f_pan_right); // free memory allocated to the f_pan_right array
+	sysmem_freeptr(x->f_wpos); // free memory allocated to the f_wpos array
+	sysmem_freeptr(x->f_wstep); // free memory allocated to the f_wstep array
 }
 
 /************************************************************************************************************************/
@@ -645,10 +1220,10 @@ void cmgrainlabs_float(t_cmgrainlabs *x, double f) {
 			}
 			break;
 		case 3: // 4th inlet
-			if (f < MIN_GRAINLENGTH) {
+			if (f < x->attr_minlength) {
 				dump = f;
 			}
-			else if (f > MAX_GRAINLENGTH) {
+			else if (f > x->attr_maxlength) {
 				dump = f;
 			}
 			else {
@@ -656,10 +1231,10 @@ void cmgrainlabs_float(t_cmgrainlabs *x, double f) {
 			}
 			break;
 		case 4: // 5th inlet
-			if (f < MIN_GRAINLENGTH) {
+			if (f < x->attr_minlength) {
 				dump = f;
 			}
-			else if (f > MAX_GRAINLENGTH) {
+			else if (f > x->attr_maxlength) {
 				dump = f;
 			}
 			else {
@@ -724,6 +1299,10 @@ t_max_err cmgrainlabs_notify(t_cmgrainlabs *x, t_symbol *s, t_symbol *msg, void
 	t_symbol *buffer_name = (t_symbol *)object_method((t_object *)sender, gensym("getname"));
 	if (msg == ps_buffer_modified) {
 		x->buffer_modified = 1;
+		if (buffer_name == x->buffer_name && x->index) { // sample buffer changed: re-analyse off the audio thread
+			x->index->dirty = 1;
+			qelem_set(x->index_qelem);
+		}
 	}
 	if (buffer_name == x->window_name) { // check if calling object was the sample buffer
 		return buffer_ref_notify(x->w_buffer, s, msg, sender, data); // return with the calling buffer
@@ -738,12 +1317,25 @@ t_max_err cmgrainlabs_notify(t_cmgrainlabs *x, t_symbol *s, t_symbol *msg, void
 /* THE BUFFER SET METHOD                                                                                                */
 /************************************************************************************************************************/
 void cmgrainlabs_set(t_cmgrainlabs *x, t_symbol *s, long ac, t_atom *av) {
+	t_cmgrainlabs_index *index, *old;
 	if (ac == 2) {
 		x->buffer_modified = 1;
 		x->buffer_name = atom_getsym(av); // write buffer name into object structure
 		x->window_name = atom_getsym(av+1); // write buffer name into object structure
 		buffer_ref_set(x->buffer, x->buffer_name);
 		buffer_ref_set(x->w_buffer, x->window_name);
+		if (!x->index || x->index->name != x->buffer_name) { // switch to the analysis index of the new sample buffer
+			critical_enter(x->match_lock);
+			old = x->index;
+			x->index = NULL;
+			critical_exit(x->match_lock);
+			cmgrainlabs_index_release(x, old);
+			index = cmgrainlabs_index_acquire(x, x->buffer_name);
+			critical_enter(x->match_lock);
+			x->index = index;
+			critical_exit(x->match_lock);
+		}
+		qelem_set(x->index_qelem);
 		if (buffer_getchannelcount((t_object *)(buffer_ref_getobject(x->buffer))) > 2) {
 			object_error((t_object *)x, "referenced sample buffer has more than 2 channels. using channels 1 and 2.");
 		}
@@ -817,3 +1409,622 @@ t_max_err cmgrainlabs_zero_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom
 	return MAX_ERR_NONE;
 }
 
+
+/************************************************************************************************************************/
+/* THE MIN GRAIN LENGTH ATTRIBUTE SET METHOD                                                                            */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_minlength_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	double length;
+	if (ac && av) {
+		length = atom_getfloat(av);
+		if (length < MIN_GRAINLENGTH) {
+			length = MIN_GRAINLENGTH;
+		}
+		else if (length > MAX_GRAINLENGTH) {
+			length = MAX_GRAINLENGTH;
+		}
+		x->attr_minlength = length;
+		if (x->attr_maxlength < length) { // keep minlength <= maxlength
+			x->attr_maxlength = length;
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE MAX GRAIN LENGTH ATTRIBUTE SET METHOD                                                                            */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_maxlength_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	double length;
+	if (ac && av) {
+		length = atom_getfloat(av);
+		if (length < MIN_GRAINLENGTH) {
+			length = MIN_GRAINLENGTH;
+		}
+		else if (length > MAX_GRAINLENGTH) {
+			length = MAX_GRAINLENGTH;
+		}
+		x->attr_maxlength = length;
+		if (x->attr_minlength > length) { // keep minlength <= maxlength
+			x->attr_minlength = length;
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE INTERNAL SCHEDULER ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_sync_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_sync = atom_getlong(av)? 1 : 0;
+		x->tr_prev = 0.0; // the trigger signal is not read while sync is on: do not compare against a stale sample
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN DENSITY ATTRIBUTE SET METHOD                                                                               */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_density_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	double density;
+	if (ac && av) {
+		density = atom_getfloat(av);
+		if (density <= 0.0) {
+			object_error((t_object *)x, "density must be greater than 0");
+			return MAX_ERR_NONE;
+		}
+		if (density > MAX_DENSITY) {
+			density = MAX_DENSITY;
+		}
+		if (x->attr_density > 0.0) { // keep the phase of the pending onset: scale the time left by new period / old period
+			x->next_onset *= x->attr_density / density;
+		}
+		x->attr_density = density;
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE ONSET JITTER ATTRIBUTE SET METHOD                                                                                */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_jitter_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	double jitter;
+	if (ac && av) {
+		jitter = atom_getfloat(av);
+		if (jitter < 0.0) {
+			jitter = 0.0;
+		}
+		else if (jitter > 1.0) {
+			jitter = 1.0;
+		}
+		x->attr_jitter = jitter;
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE FEATURE SELECTION ATTRIBUTE SET METHOD                                                                           */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_select_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_select = atom_getlong(av)? 1 : 0;
+		if (x->index_qelem) {
+			qelem_set(x->index_qelem);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE RMS SELECTION RANGE ATTRIBUTE SET METHOD                                                                         */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_rms_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac > 1 && av) {
+		x->attr_rms[0] = atom_getfloat(av);
+		x->attr_rms[1] = atom_getfloat(av+1);
+		if (x->index_qelem) {
+			qelem_set(x->index_qelem);
+		}
+	}
+	else {
+		object_error((t_object *)x, "%d arguments required (min/max)", 2);
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE CENTROID SELECTION RANGE ATTRIBUTE SET METHOD                                                                    */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_centroid_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac > 1 && av) {
+		x->attr_centroid[0] = atom_getfloat(av);
+		x->attr_centroid[1] = atom_getfloat(av+1);
+		if (x->index_qelem) {
+			qelem_set(x->index_qelem);
+		}
+	}
+	else {
+		object_error((t_object *)x, "%d arguments required (min/max)", 2);
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE ONSET SELECTION ATTRIBUTE SET METHOD                                                                             */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_onsets_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_onsets = atom_getlong(av)? 1 : 0;
+		if (x->index_qelem) {
+			qelem_set(x->index_qelem);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* GET (OR CREATE) THE SHARED ANALYSIS INDEX FOR A SAMPLE BUFFER NAME                                                   */
+/************************************************************************************************************************/
+t_cmgrainlabs_index *cmgrainlabs_index_acquire(t_cmgrainlabs *x, t_symbol *name) {
+	t_cmgrainlabs_index *index = NULL;
+	if (hashtab_lookup(cmgrainlabs_indexes, name, (t_object **)&index) != MAX_ERR_NONE || !index) {
+		index = (t_cmgrainlabs_index *)sysmem_newptrclear(sizeof(t_cmgrainlabs_index));
+		if (index == NULL) {
+			return NULL;
+		}
+		index->name = name;
+		index->refcount = 0;
+		index->dirty = 1; // analysis is started by the first index update that needs it
+		index->framecount = 0;
+		index->frames = NULL;
+		index->crossings = NULL;
+		index->crossingcount = 0;
+		index->thread = NULL;
+		index->busy = 0;
+		index->cancel = 0;
+		index->buffer = NULL;
+		index->users = NULL;
+		critical_new(&index->frames_lock);
+		critical_new(&index->lock);
+		hashtab_store(cmgrainlabs_indexes, name, (t_object *)index);
+	}
+	index->refcount++;
+	critical_enter(index->lock); // the user list is walked by the analysis thread
+	x->index_next = index->users;
+	index->users = x;
+	critical_exit(index->lock);
+	return index;
+}
+
+
+/************************************************************************************************************************/
+/* RELEASE THE SHARED ANALYSIS INDEX (FREED WHEN THE LAST INSTANCE RELEASES IT)                                         */
+/************************************************************************************************************************/
+void cmgrainlabs_index_release(t_cmgrainlabs *x, t_cmgrainlabs_index *index) {
+	t_cmgrainlabs **user;
+	unsigned int ret;
+	if (index == NULL) {
+		return;
+	}
+	critical_enter(index->lock);
+	for (user = &index->users; *user; user = &(*user)->index_next) {
+		if (*user == x) {
+			*user = x->index_next;
+			break;
+		}
+	}
+	x->index_next = NULL;
+	critical_exit(index->lock);
+	if (--index->refcount > 0) {
+		return;
+	}
+	hashtab_chuckkey(cmgrainlabs_indexes, index->name);
+	if (index->thread) { // stop a running analysis and wait for the thread to finish
+		critical_enter(index->lock);
+		index->cancel = 1;
+		critical_exit(index->lock);
+		systhread_join(index->thread, &ret);
+	}
+	if (index->frames) {
+		sysmem_freeptr(index->frames);
+	}
+	if (index->crossings) {
+		sysmem_freeptr(index->crossings);
+	}
+	critical_free(index->frames_lock);
+	critical_free(index->lock);
+	sysmem_freeptr(index);
+}
+
+
+/************************************************************************************************************************/
+/* ANALYSE THE SAMPLE BUFFER: PER FRAME RMS, SPECTRAL CENTROID AND ONSET MARKERS (RUNS ON THE ANALYSIS THREAD)          */
+/************************************************************************************************************************/
+void cmgrainlabs_index_build(t_cmgrainlabs_index *index, t_buffer_obj *buffer) {
+	float *b_sample;
+	long b_framecount = 0, framecount = 0, i, j, k, pos;
+	t_atom_long b_channelcount;
+	double sr, sum, mix, magnitude, weighted, total, prev_rms = 0.0;
+	double *re = NULL, *im = NULL, *hann = NULL, *tw_re = NULL, *tw_im = NULL;
+	t_cmgrainlabs_frame *frames = NULL, *old_frames;
+	t_int32 *crossings = NULL, *old_crossings;
+	long crossingcount = 0;
+	long pass;
+	short cancel;
+	double prev_mix;
+	
+	b_sample = buffer ? buffer_locksamples(buffer) : NULL;
+	if (!b_sample) { // buffer does not exist: leave the index empty
+		goto unlock;
+	}
+	b_framecount = buffer_getframecount(buffer);
+	b_channelcount = buffer_getchannelcount(buffer);
+	sr = buffer_getsamplerate(buffer);
+	if (b_framecount > 0x7FFFFFFF) { // positions are stored as 32 bit integers
+		goto unlock;
+	}
+	framecount = (b_framecount + INDEX_HOPSIZE - 1) / INDEX_HOPSIZE;
+	
+	frames = (t_cmgrainlabs_frame *)sysmem_newptrclear(framecount * sizeof(t_cmgrainlabs_frame));
+	re = (double *)sysmem_newptr(INDEX_FRAMESIZE * sizeof(double));
+	im = (double *)sysmem_newptr(INDEX_FRAMESIZE * sizeof(double));
+	hann = (double *)sysmem_newptr(INDEX_FRAMESIZE * sizeof(double));
+	tw_re = (double *)sysmem_newptr((INDEX_FRAMESIZE / 2) * sizeof(double));
+	tw_im = (double *)sysmem_newptr((INDEX_FRAMESIZE / 2) * sizeof(double));
+	if (!framecount || !frames || !re || !im || !hann || !tw_re || !tw_im) {
+		framecount = 0;
+		goto unlock;
+	}
+	for (j = 0; j < INDEX_FRAMESIZE; j++) {
+		hann[j] = 0.5 - 0.5 * cos(2.0 * M_PI * j / INDEX_FRAMESIZE);
+	}
+	for (j = 0; j < INDEX_FRAMESIZE / 2; j++) { // fft twiddle factors
+		tw_re[j] = cos(-2.0 * M_PI * j / INDEX_FRAMESIZE);
+		tw_im[j] = sin(-2.0 * M_PI * j / INDEX_FRAMESIZE);
+	}
+	
+	for (i = 0; i < framecount; i++) {
+		critical_enter(index->lock); // the cancel flag is set by the thread releasing the index
+		cancel = index->cancel;
+		critical_exit(index->lock);
+		if (cancel) { // index is being released: discard the analysis
+			framecount = 0;
+			goto unlock;
+		}
+		// MIX DOWN ALL CHANNELS AND ACCUMULATE THE FRAME ENERGY
+		sum = 0.0;
+		for (j = 0; j < INDEX_FRAMESIZE; j++) {
+			pos = i * INDEX_HOPSIZE + j;
+			mix = 0.0;
+			if (pos < b_framecount) {
+				for (k = 0; k < b_channelcount; k++) {
+					mix += b_sample[pos * b_channelcount + k];
+				}
+				mix /= b_channelcount;
+			}
+			sum += mix * mix;
+			re[j] = mix * hann[j];
+			im[j] = 0.0;
+		}
+		frames[i].rms = sqrt(sum / INDEX_FRAMESIZE);
+		
+		// SPECTRAL CENTROID (MAGNITUDE WEIGHTED MEAN FREQUENCY)
+		cmgrainlabs_fft(re, im, INDEX_FRAMESIZE, tw_re, tw_im);
+		weighted = 0.0;
+		total = 0.0;
+		for (j = 1; j < INDEX_FRAMESIZE / 2; j++) {
+			magnitude = sqrt(re[j] * re[j] + im[j] * im[j]);
+			weighted += magnitude * j;
+			total += magnitude;
+		}
+		frames[i].centroid = total > 0.0 ? (weighted / total) * (sr / INDEX_FRAMESIZE) : 0.0;
+		
+		// ONSET MARKER (ENERGY RISE RELATIVE TO THE PREVIOUS FRAME)
+		frames[i].onset = (frames[i].rms > INDEX_ONSET_FLOOR && frames[i].rms > INDEX_ONSET_RATIO * prev_rms);
+		prev_rms = frames[i].rms;
+	}
+	
+	// ZERO CROSSING INDEX (UPWARD CROSSINGS OF THE CHANNEL MIX) - FIRST PASS COUNTS, SECOND PASS FILLS
+	for (pass = 0; pass < 2; pass++) {
+		if (pass) {
+			if (!crossingcount) {
+				break;
+			}
+			crossings = (t_int32 *)sysmem_newptr(crossingcount * sizeof(t_int32));
+			if (crossings == NULL) {
+				crossingcount = 0;
+				break;
+			}
+			crossingcount = 0;
+		}
+		prev_mix = 0.0;
+		for (pos = 0; pos < b_framecount; pos++) {
+			mix = 0.0;
+			for (k = 0; k < b_channelcount; k++) {
+				mix += b_sample[pos * b_channelcount + k];
+			}
+			if (pos > 0 && prev_mix < 0.0 && mix >= 0.0) {
+				if (pass) {
+					crossings[crossingcount] = (t_int32)pos;
+				}
+				crossingcount++;
+			}
+			prev_mix = mix;
+		}
+	}
+	
+unlock:
+	if (buffer) {
+		buffer_unlocksamples(buffer);
+	}
+	if (!framecount) { // no buffer, analysis failed or was cancelled: publish an empty index
+		crossingcount = 0;
+	}
+	
+	// SWAP THE ANALYSIS RESULTS INTO THE SHARED INDEX (ONLY THE CROSSINGS ARE READ BY THE PERFORM ROUTINE)
+	critical_enter(index->frames_lock);
+	old_frames = index->frames;
+	index->frames = framecount ? frames : NULL;
+	index->framecount = framecount;
+	critical_exit(index->frames_lock);
+	critical_enter(index->lock);
+	old_crossings = index->crossings;
+	index->crossings = crossingcount ? crossings : NULL;
+	index->crossingcount = crossingcount;
+	critical_exit(index->lock);
+	if (old_frames) {
+		sysmem_freeptr(old_frames);
+	}
+	if (old_crossings) {
+		sysmem_freeptr(old_crossings);
+	}
+	if (frames && !framecount) {
+		sysmem_freeptr(frames);
+	}
+	if (crossings && !crossingcount) {
+		sysmem_freeptr(crossings);
+	}
+	if (re) {
+		sysmem_freeptr(re);
+	}
+	if (im) {
+		sysmem_freeptr(im);
+	}
+	if (hann) {
+		sysmem_freeptr(hann);
+	}
+	if (tw_re) {
+		sysmem_freeptr(tw_re);
+	}
+	if (tw_im) {
+		sysmem_freeptr(tw_im);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* ANALYSIS THREAD: BUILD THE INDEX, THEN LET ALL SHARING INSTANCES REBUILD THEIR MATCH LISTS                           */
+/************************************************************************************************************************/
+void *cmgrainlabs_index_thread(t_cmgrainlabs_index *index) {
+	t_cmgrainlabs *user;
+	cmgrainlabs_index_build(index, index->buffer);
+	critical_enter(index->lock);
+	index->busy = 0;
+	if (!index->cancel) {
+		for (user = index->users; user; user = user->index_next) {
+			qelem_set(user->index_qelem);
+		}
+	}
+	critical_exit(index->lock);
+	systhread_exit(0);
+	return NULL;
+}
+
+
+/************************************************************************************************************************/
+/* INDEX UPDATE ROUTINE (QELEM, STARTS THE ANALYSIS THREAD AND REBUILDS THE MATCH LIST)                                 */
+/************************************************************************************************************************/
+void cmgrainlabs_index_update(t_cmgrainlabs *x) {
+	t_cmgrainlabs_index *index = x->index;
+	t_int32 *match = NULL;
+	t_int32 *old;
+	long count = 0;
+	long i;
+	short busy;
+	unsigned int ret;
+	
+	if (index == NULL) {
+		return;
+	}
+	// START THE ANALYSIS ONLY IF THIS INSTANCE NEEDS IT (SELECT OR SNAP) AND NO ANALYSIS IS RUNNING
+	critical_enter(index->lock);
+	busy = index->busy;
+	critical_exit(index->lock);
+	if ((x->attr_select || x->attr_snap) && index->dirty && !busy) {
+		if (index->thread) { // reap the previous (finished) analysis thread
+			systhread_join(index->thread, &ret);
+			index->thread = NULL;
+		}
+		index->dirty = 0;
+		index->busy = 1;
+		index->buffer = buffer_ref_getobject(x->buffer);
+		if (systhread_create((method)cmgrainlabs_index_thread, index, 0, 0, 0, &index->thread) != MAX_ERR_NONE) {
+			object_error((t_object *)x, "could not start the analysis thread");
+			index->thread = NULL;
+			index->busy = 0;
+			index->dirty = 1;
+		}
+	}
+	
+	// BUILD THE MATCH LIST FOR THE CURRENT SELECTION ATTRIBUTES (ASCENDING BUFFER POSITIONS)
+	// only the frame table lock is held here, the perform routine never waits for the allocation or the loop
+	critical_enter(index->frames_lock); // the analysis thread swaps the frame table under this lock
+	if (x->attr_select && index->framecount) {
+		match = (t_int32 *)sysmem_newptr(index->framecount * sizeof(t_int32));
+		if (match == NULL) {
+			critical_exit(index->frames_lock);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		for (i = 0; i < index->framecount; i++) {
+			if (index->frames[i].rms < x->attr_rms[0] || index->frames[i].rms > x->attr_rms[1]) {
+				continue;
+			}
+			if (index->frames[i].centroid < x->attr_centroid[0] || index->frames[i].centroid > x->attr_centroid[1]) {
+				continue;
+			}
+			if (x->attr_onsets && !index->frames[i].onset) {
+				continue;
+			}
+			match[count++] = (t_int32)(i * INDEX_HOPSIZE);
+		}
+	}
+	critical_exit(index->frames_lock);
+	
+	// SWAP THE MATCH LIST USED BY THE PERFORM ROUTINE (POINTERS ONLY)
+	critical_enter(x->match_lock);
+	old = x->match;
+	x->match = match;
+	x->match_count = count;
+	critical_exit(x->match_lock);
+	if (old) {
+		sysmem_freeptr(old);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* IN-PLACE RADIX-2 FFT (N MUST BE A POWER OF 2, TWIDDLE TABLES HOLD N/2 FACTORS)                                       */
+/************************************************************************************************************************/
+void cmgrainlabs_fft(double *re, double *im, long n, double *tw_re, double *tw_im) {
+	long i, j, k, m, half, step;
+	double t_re, t_im, w_re, w_im, u_re, u_im;
+	
+	// BIT REVERSAL PERMUTATION
+	for (i = 1, j = 0; i < n; i++) {
+		m = n >> 1;
+		while (j & m) {
+			j ^= m;
+			m >>= 1;
+		}
+		j |= m;
+		if (i < j) {
+			t_re = re[i]; re[i] = re[j]; re[j] = t_re;
+			t_im = im[i]; im[i] = im[j]; im[j] = t_im;
+		}
+	}
+	// BUTTERFLIES
+	for (m = 2; m <= n; m <<= 1) {
+		half = m >> 1;
+		step = n / m; // stride into the twiddle tables for this stage
+		for (k = 0; k < half; k++) {
+			w_re = tw_re[k * step];
+			w_im = tw_im[k * step];
+			for (i = k; i < n; i += m) {
+				j = i + half;
+				u_re = re[j] * w_re - im[j] * w_im;
+				u_im = re[j] * w_im + im[j] * w_re;
+				re[j] = re[i] - u_re;
+				im[j] = im[i] - u_im;
+				re[i] += u_re;
+				im[i] += u_im;
+			}
+		}
+	}
+}
+
+
+/************************************************************************************************************************/
+/* BINARY SEARCH: INDEX OF THE FIRST ELEMENT NOT SMALLER THAN VALUE                                                     */
+/************************************************************************************************************************/
+long cmgrainlabs_lowerbound(t_int32 *array, long count, double value) {
+	long lo = 0;
+	long hi = count;
+	long mid;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		if (array[mid] < value) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+/************************************************************************************************************************/
+/* THE ZERO CROSSING SNAP ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_snap_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_snap = atom_getlong(av)? 1 : 0;
+		if (x->index_qelem) {
+			qelem_set(x->index_qelem); // the crossing index is only built while select or snap are on
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE PRECISION ATTRIBUTE SET METHOD                                                                                   */
+/************************************************************************************************************************/
+t_max_err cmgrainlabs_precision_set(t_cmgrainlabs *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_precision = atom_getlong(av)? 1 : 0;
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* DOUBLE PRECISION LINEAR INTERPOLATION (THE LAST FRAME IS HELD, NOTHING IS READ PAST THE END OF THE BUFFER)           */
+/************************************************************************************************************************/
+static inline double cmgrainlabs_lininterp(double distance, float *buffer, long framecount, t_atom_long channelcount, short channel) {
+	long index = (long)distance;
+	double a, b;
+	if (index >= framecount - 1) {
+		return buffer[(framecount - 1) * channelcount + channel];
+	}
+	a = buffer[index * channelcount + channel];
+	b = buffer[(index + 1) * channelcount + channel];
+	return a + (distance - index) * (b - a);
+}
+
+
+/************************************************************************************************************************/
+/* SINGLE PRECISION LINEAR INTERPOLATION (FLOAT32 PRECISION MODE)                                                       */
+/************************************************************************************************************************/
+static inline float cmgrainlabs_lininterp_f(long index, float frac, float *buffer, long framecount, t_atom_long channelcount, short channel) {
+	long next = (index + 1 < framecount) ? index + 1 : index;
+	float a = buffer[index * channelcount + channel];
+	float b = buffer[next * channelcount + channel];
+	return a + frac * (b - a);
+}
+
+
+
+/************************************************************************************************************************/
+/* STREAMING READ PATH: KEEP THE PREFETCH CURSOR UP TO PREFETCH_FRAMES AHEAD OF THE READ HEAD                           */
+/************************************************************************************************************************/
+static inline void cmgrainlabs_prefetch(t_cmgrainlabs *x, long i, double from, double to, float *b_sample, long b_framecount, t_atom_long b_channelcount, long p_step) {
+	if (x->prefetchpos[i] < (long)from) { // lines behind the read head are of no use (high pitch)
+		x->prefetchpos[i] = (long)from;
+	}
+	while (x->prefetchpos[i] <= (long)to && x->prefetchpos[i] < b_framecount) {
+		CM_PREFETCH(b_sample + x->prefetchpos[i] * b_channelcount);
+		x->prefetchpos[i] += p_step; // advance by one cache line
+	}
+}
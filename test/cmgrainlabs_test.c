@@ -0,0 +1,940 @@
+// Headless test harness for cm.grainlabs~: builds the external against the stand-in Max runtime in stubs/
+// and renders it without Max. Usage: cmgrainlabs_test <golden|rate|sync|precision|index|bench> [options], see the tests table below.
+#include <stdint.h>
+#include <time.h>
+#define main cmgrainlabs_main // the external's class initialization routine
+#include "cm.grainlabs~.c"
+#undef main
+#include "maxstubs.h"
+
+#define TEST_SR 44100.0 // sample rate of the golden renders
+#define TEST_VECTORSIZE 64 // signal vector size
+#define TEST_SOURCEFRAMES 16384 // frames of the synthetic stereo source buffer
+#define TEST_LONGSOURCEFRAMES (20 * 44100) // frames of the synthetic stereo source buffer for the streaming read path (20 s)
+#define TEST_TRIGGERPERIOD 32 // period of the trigger ramp in samples
+#define GOLDEN_FRAMES 256 // rendered frames per golden case
+#define GOLDEN_TOLERANCE 1e-5 // max absolute deviation from the golden output
+#define STREAM_FRAMES 16384 // rendered frames of the streaming golden case
+#define PRECISION_TOLERANCE 1e-5 // max absolute deviation of the float32 mode from the double mode (-100 dB)
+#define PRECISION_POSITION 1e-3 // max window position error of the float32 mode in window frames
+#define BENCH_SECONDS 2.0 // rendered duration per benchmark run
+#define BENCH_RUNS 5 // the fastest of these runs is reported
+#define BENCH_CALIBRATION_READS (1L << 22) // interpolated reads per calibration run
+
+static const char *test_windows[] = {
+	"bartlett-hanning", "bartlett", "blackman-harris", "blackman", "bohman", "chebyshef",
+	"flat-top", "gauss", "hamming", "hanning", "kaiser", "nuttall",
+	"parzen", "rectangular", "taylor", "triangular", "turkey", "white-noise"
+};
+#define TEST_WINDOWCOUNT (long)(sizeof(test_windows) / sizeof(test_windows[0]))
+
+
+/************************************************************************************************************************/
+/* SEEDED RANDOM NUMBER SOURCE (INSTALLED AS THE EXTERNAL'S RANDOM HOOK)                                                */
+/************************************************************************************************************************/
+static uint64_t test_state;
+
+static void test_seed(uint64_t seed) {
+	test_state = seed ? seed : 1;
+}
+
+static double test_random(double *min, double *max) {
+	test_state ^= test_state << 13; // xorshift64
+	test_state ^= test_state >> 7;
+	test_state ^= test_state << 17;
+	return *min + (*max - *min) * ((test_state >> 11) * (1.0 / 9007199254740992.0));
+}
+
+
+/************************************************************************************************************************/
+/* WAV FILES (16/24/32 BIT PCM)                                                                                         */
+/************************************************************************************************************************/
+static unsigned long test_le(const unsigned char *p, int bytes) {
+	unsigned long value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--) {
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+// load a wav file into interleaved float samples, returns the number of frames or 0 on failure
+static long test_loadwav(const char *path, float **samples, long *channelcount, double *samplerate) {
+	FILE *f = fopen(path, "rb");
+	unsigned char *data = NULL, *p, *chunk;
+	long size, chunksize, framecount = 0, i;
+	int format = 0, bits = 0, bytes;
+	unsigned long raw;
+
+	*samples = NULL;
+	if (f == NULL) {
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size);
+	if (fread(data, 1, size, f) != (size_t)size || size < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+		goto done;
+	}
+	for (p = data + 12; p + 8 <= data + size; p += 8 + chunksize + (chunksize & 1)) {
+		chunk = p + 8;
+		chunksize = (long)test_le(p + 4, 4);
+		if (chunk + chunksize > data + size) {
+			chunksize = (long)(data + size - chunk);
+		}
+		if (!memcmp(p, "fmt ", 4)) {
+			format = (int)test_le(chunk, 2);
+			*channelcount = (long)test_le(chunk + 2, 2);
+			*samplerate = (double)test_le(chunk + 4, 4);
+			bits = (int)test_le(chunk + 14, 2);
+		}
+		else if (!memcmp(p, "data", 4) && bits && *channelcount) {
+			if (format != 1 && format != 0xFFFE) { // pcm or extensible pcm
+				goto done;
+			}
+			bytes = bits / 8;
+			framecount = chunksize / (bytes * *channelcount);
+			*samples = malloc(framecount * *channelcount * sizeof(float));
+			for (i = 0; i < framecount * *channelcount; i++) {
+				raw = test_le(chunk + i * bytes, bytes);
+				if (raw & (1UL << (bits - 1))) { // sign extend
+					raw |= ~0UL << bits;
+				}
+				(*samples)[i] = (float)((long)raw / (double)(1UL << (bits - 1)));
+			}
+			break;
+		}
+	}
+done:
+	free(data);
+	fclose(f);
+	return framecount;
+}
+
+
+/************************************************************************************************************************/
+/* BUFFERS AND INSTANCES                                                                                                */
+/************************************************************************************************************************/
+// deterministic stereo source: two partials per channel with different frequencies and a slow amplitude swell
+static void test_source(void) {
+	float *samples = malloc(TEST_SOURCEFRAMES * 2 * sizeof(float));
+	long i;
+	double t;
+	for (i = 0; i < TEST_SOURCEFRAMES; i++) {
+		t = i / TEST_SR;
+		samples[i * 2] = (float)((0.6 * sin(2.0 * M_PI * 220.0 * t) + 0.3 * sin(2.0 * M_PI * 1375.0 * t)) * (0.5 + 0.5 * sin(2.0 * M_PI * 3.0 * t)));
+		samples[i * 2 + 1] = (float)((0.5 * sin(2.0 * M_PI * 330.0 * t) + 0.4 * sin(2.0 * M_PI * 2750.0 * t)) * (0.5 + 0.5 * cos(2.0 * M_PI * 5.0 * t)));
+	}
+	stub_buffer_set("source", samples, TEST_SOURCEFRAMES, 2, TEST_SR);
+	free(samples);
+	
+	// long source for the streaming read path: the same partials with a slow pitch glide, larger than the l2 cache
+	samples = malloc(TEST_LONGSOURCEFRAMES * 2 * sizeof(float));
+	for (i = 0; i < TEST_LONGSOURCEFRAMES; i++) {
+		t = i / TEST_SR;
+		samples[i * 2] = (float)((0.6 * sin(2.0 * M_PI * 220.0 * t * (1.0 + 0.01 * t)) + 0.3 * sin(2.0 * M_PI * 1375.0 * t)) * (0.5 + 0.5 * sin(2.0 * M_PI * 0.7 * t)));
+		samples[i * 2 + 1] = (float)((0.5 * sin(2.0 * M_PI * 330.0 * t * (1.0 - 0.01 * t)) + 0.4 * sin(2.0 * M_PI * 2750.0 * t)) * (0.5 + 0.5 * cos(2.0 * M_PI * 0.3 * t)));
+	}
+	stub_buffer_set("longsource", samples, TEST_LONGSOURCEFRAMES, 2, TEST_SR);
+	free(samples);
+}
+
+// load all example windows into buffers named after the file
+static int test_windowbuffers(void) {
+	char path[1024];
+	float *samples;
+	long framecount, channelcount = 0, i;
+	double samplerate = 0.0;
+	for (i = 0; i < TEST_WINDOWCOUNT; i++) {
+		snprintf(path, sizeof(path), "%s/%s.wav", CMGRAINLABS_WINDOWS_DIR, test_windows[i]);
+		framecount = test_loadwav(path, &samples, &channelcount, &samplerate);
+		if (!framecount) {
+			fprintf(stderr, "could not load %s\n", path);
+			return 0;
+		}
+		stub_buffer_set(test_windows[i], samples, framecount, channelcount, samplerate);
+		free(samples);
+	}
+	return 1;
+}
+
+static t_cmgrainlabs *test_newsource(const char *source, const char *window, long voices, double samplerate) {
+	t_atom argv[3];
+	atom_setsym(argv, gensym(source));
+	atom_setsym(argv + 1, gensym(window));
+	atom_setlong(argv + 2, voices);
+	stub_set_sr(samplerate);
+	return (t_cmgrainlabs *)cmgrainlabs_new(gensym("cm.grainlabs~"), 3, argv);
+}
+
+static t_cmgrainlabs *test_new(const char *window, long voices, double samplerate) {
+	return test_newsource("source", window, voices, samplerate);
+}
+
+static void test_free(t_cmgrainlabs *x) {
+	cmgrainlabs_free(x);
+	free(x);
+}
+
+// send a float to one of the float inlets (1 - 8)
+static void test_inlet(t_cmgrainlabs *x, long inlet, double value) {
+	((t_pxobject *)x)->z_in = inlet;
+	cmgrainlabs_float(x, value);
+	((t_pxobject *)x)->z_in = 0;
+}
+
+static void test_dsp(t_cmgrainlabs *x, double samplerate) {
+	short count[9] = {1, 0, 0, 0, 0, 0, 0, 0, 0}; // only the trigger inlet is connected
+	cmgrainlabs_dsp64(x, NULL, count, samplerate, TEST_VECTORSIZE, 0);
+}
+
+// render frames (a multiple of the vector size) with the trigger ramp, interleaved stereo output
+static void test_render(t_cmgrainlabs *x, long frames, long *phase, double *output) {
+	double trigger[TEST_VECTORSIZE], zeros[TEST_VECTORSIZE] = {0.0}, left[TEST_VECTORSIZE], right[TEST_VECTORSIZE];
+	double *ins[9], *outs[2] = {left, right};
+	long v, k;
+	ins[0] = trigger;
+	for (k = 1; k < 9; k++) {
+		ins[k] = zeros;
+	}
+	for (v = 0; v < frames / TEST_VECTORSIZE; v++) {
+		for (k = 0; k < TEST_VECTORSIZE; k++) { // ramp in (-0.5, 0.5) that never hits 0, so both trigger modes fire once per period
+			trigger[k] = ((*phase % TEST_TRIGGERPERIOD) + 0.5) / TEST_TRIGGERPERIOD - 0.5;
+			(*phase)++;
+		}
+		cmgrainlabs_perform64(x, NULL, ins, 9, outs, 2, TEST_VECTORSIZE, 0, NULL);
+		if (output) {
+			for (k = 0; k < TEST_VECTORSIZE; k++) {
+				output[(v * TEST_VECTORSIZE + k) * 2] = left[k];
+				output[(v * TEST_VECTORSIZE + k) * 2 + 1] = right[k];
+			}
+		}
+	}
+}
+
+
+/************************************************************************************************************************/
+/* GOLDEN RENDERS: EVERY WINDOW x STEREO x W_INTERP x S_INTERP x ZERO                                                   */
+/************************************************************************************************************************/
+// render one golden case: bit 0 stereo, bit 1 w_interp, bit 2 s_interp, bit 3 zero
+static void test_goldencase(const char *window, long c, long precision, double *output) {
+	t_cmgrainlabs *x;
+	long phase = 0;
+	test_seed(0x5EED0000 + c);
+	x = test_new(window, 16, TEST_SR);
+	object_attr_setlong(x, gensym("stereo"), c & 1);
+	object_attr_setlong(x, gensym("w_interp"), (c >> 1) & 1);
+	object_attr_setlong(x, gensym("s_interp"), (c >> 2) & 1);
+	object_attr_setlong(x, gensym("zero"), (c >> 3) & 1);
+	object_attr_setlong(x, gensym("precision"), precision);
+	test_inlet(x, 1, 0.0); // start range in ms
+	test_inlet(x, 2, 300.0);
+	test_inlet(x, 3, 1.0); // length range in ms
+	test_inlet(x, 4, 3.0);
+	test_inlet(x, 5, 0.5); // pitch range
+	test_inlet(x, 6, 2.0);
+	test_inlet(x, 7, -1.0); // pan range
+	test_inlet(x, 8, 1.0);
+	test_dsp(x, TEST_SR);
+	test_render(x, GOLDEN_FRAMES, &phase, output);
+	test_free(x);
+}
+
+// multi-second grains at high density on the long source, every grain reads more than STREAM_GRAINLENGTH ms of source
+// (prefetch 0 disables the streaming read path), returns the number of grains rendered with the streaming read path
+static long test_streamcase(long prefetch, long precision, double *output) {
+	t_cmgrainlabs *x;
+	long phase = 0, streamed = 0, v, i;
+	test_seed(0x57EA4);
+	x = test_newsource("longsource", "hanning", 64, TEST_SR);
+	object_attr_setlong(x, gensym("stereo"), 1);
+	object_attr_setlong(x, gensym("w_interp"), 1);
+	object_attr_setlong(x, gensym("s_interp"), 1);
+	object_attr_setlong(x, gensym("precision"), precision);
+	object_attr_setfloat(x, gensym("maxlength"), 4000.0);
+	object_attr_setlong(x, gensym("sync"), 1);
+	object_attr_setfloat(x, gensym("density"), 200.0);
+	object_attr_setfloat(x, gensym("jitter"), 0.5);
+	test_inlet(x, 2, 16000.0); // start range in ms
+	test_inlet(x, 4, 4000.0); // length range in ms
+	test_inlet(x, 3, 2000.0);
+	test_inlet(x, 5, 0.5); // pitch range: at least 1000 ms of source per grain
+	test_inlet(x, 6, 2.0);
+	test_inlet(x, 7, -1.0); // pan range
+	test_inlet(x, 8, 1.0);
+	test_dsp(x, TEST_SR);
+	if (!prefetch) {
+		x->stream_frames = HUGE_VAL; // no grain is long enough for the streaming read path
+	}
+	for (v = 0; v < STREAM_FRAMES / TEST_VECTORSIZE; v++) {
+		test_render(x, TEST_VECTORSIZE, &phase, output + v * TEST_VECTORSIZE * 2);
+		for (i = 0; i < MAXGRAINS; i++) { // grains are born once and live longer than the render
+			streamed += x->busy[i] && x->streaming[i] && x->grainpos[i] * x->t_length[i] * x->m_sr < TEST_VECTORSIZE;
+		}
+	}
+	test_free(x);
+	return streamed;
+}
+
+// streaming golden: compares against the golden render and requires the same output without the streaming read path
+static long test_goldenstream(int update) {
+	double *output = malloc(STREAM_FRAMES * 2 * sizeof(double)), *reference = malloc(STREAM_FRAMES * 2 * sizeof(double));
+	float *golden = malloc(STREAM_FRAMES * 2 * sizeof(float));
+	double deviation, maxdeviation = 0.0, energy = 0.0;
+	long i, p, streamed, failures = 0;
+	char path[1024];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/streaming.f32", CMGRAINLABS_GOLDEN_DIR);
+	streamed = test_streamcase(1, 1, output);
+	for (i = 0; i < STREAM_FRAMES * 2; i++) {
+		energy += output[i] * output[i];
+		golden[i] = (float)output[i];
+	}
+	if (update) {
+		f = fopen(path, "wb");
+		if (f == NULL || fwrite(golden, sizeof(float), STREAM_FRAMES * 2, f) != STREAM_FRAMES * 2) {
+			fprintf(stderr, "could not write %s\n", path);
+			failures++;
+		}
+	}
+	else {
+		f = fopen(path, "rb");
+		if (f == NULL || fread(golden, sizeof(float), STREAM_FRAMES * 2, f) != STREAM_FRAMES * 2) {
+			fprintf(stderr, "streaming: missing or short golden file %s\n", path);
+			failures++;
+		}
+		for (i = 0; f && !failures && i < STREAM_FRAMES * 2; i++) {
+			deviation = fabs(output[i] - golden[i]);
+			maxdeviation = deviation > maxdeviation ? deviation : maxdeviation;
+		}
+	}
+	if (f) {
+		fclose(f);
+	}
+	if (energy == 0.0 || !streamed) {
+		fprintf(stderr, "streaming: %s\n", energy == 0.0 ? "silent output" : "no grain took the streaming read path");
+		failures++;
+	}
+	if (maxdeviation > GOLDEN_TOLERANCE) {
+		fprintf(stderr, "streaming: max deviation %g\n", maxdeviation);
+		failures++;
+	}
+	for (p = 0; p < 2; p++) { // prefetching must not change the output in either precision mode
+		test_streamcase(1, p, reference);
+		if (test_streamcase(0, p, output)) {
+			fprintf(stderr, "streaming: grains took the streaming read path with prefetch disabled\n");
+			failures++;
+		}
+		if (memcmp(output, reference, STREAM_FRAMES * 2 * sizeof(double))) {
+			fprintf(stderr, "streaming: output with prefetch differs from the output without (precision %ld)\n", p);
+			failures++;
+		}
+	}
+	printf("streaming: %ld grains on the streaming read path, %ld failures%s\n", streamed, failures, update ? " (updated)" : "");
+	free(output);
+	free(reference);
+	free(golden);
+	return failures;
+}
+
+static int test_golden(int argc, char **argv) {
+	int update = argc > 0 && !strcmp(argv[0], "--update");
+	long w, c, i, failures = 0;
+	double output[GOLDEN_FRAMES * 2], deviation, maxdeviation, energy;
+	float *golden = malloc(16 * GOLDEN_FRAMES * 2 * sizeof(float));
+	char path[1024];
+	FILE *f;
+
+	for (w = 0; w < TEST_WINDOWCOUNT; w++) {
+		snprintf(path, sizeof(path), "%s/%s.f32", CMGRAINLABS_GOLDEN_DIR, test_windows[w]);
+		if (!update) {
+			f = fopen(path, "rb");
+			if (f == NULL || fread(golden, sizeof(float), 16 * GOLDEN_FRAMES * 2, f) != 16 * GOLDEN_FRAMES * 2) {
+				fprintf(stderr, "%s: missing or short golden file %s\n", test_windows[w], path);
+				failures++;
+				if (f) {
+					fclose(f);
+				}
+				continue;
+			}
+			fclose(f);
+		}
+		for (c = 0; c < 16; c++) {
+			test_goldencase(test_windows[w], c, 1, output);
+
+			maxdeviation = 0.0;
+			energy = 0.0;
+			for (i = 0; i < GOLDEN_FRAMES * 2; i++) {
+				energy += output[i] * output[i];
+				if (update) {
+					golden[c * GOLDEN_FRAMES * 2 + i] = (float)output[i];
+				}
+				else {
+					deviation = fabs(output[i] - golden[c * GOLDEN_FRAMES * 2 + i]);
+					maxdeviation = deviation > maxdeviation ? deviation : maxdeviation;
+				}
+			}
+			if (energy == 0.0) {
+				fprintf(stderr, "%s case %ld: silent output\n", test_windows[w], c);
+				failures++;
+			}
+			if (maxdeviation > GOLDEN_TOLERANCE) {
+				fprintf(stderr, "%s case %ld (stereo %ld w_interp %ld s_interp %ld zero %ld): max deviation %g\n",
+						test_windows[w], c, c & 1, (c >> 1) & 1, (c >> 2) & 1, (c >> 3) & 1, maxdeviation);
+				failures++;
+			}
+		}
+		if (update) {
+			f = fopen(path, "wb");
+			if (f == NULL || fwrite(golden, sizeof(float), 16 * GOLDEN_FRAMES * 2, f) != 16 * GOLDEN_FRAMES * 2) {
+				fprintf(stderr, "could not write %s\n", path);
+				failures++;
+			}
+			if (f) {
+				fclose(f);
+			}
+		}
+	}
+	free(golden);
+	printf("golden: %ld windows x 16 cases, %ld failures%s\n", TEST_WINDOWCOUNT, failures, update ? " (updated)" : "");
+	failures += test_goldenstream(update);
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* SAMPLE RATES: GRAIN DURATION IN MS IS RATE INDEPENDENT, ALSO ACROSS A RATE CHANGE WHILE THE GRAIN PLAYS             */
+/************************************************************************************************************************/
+// one grain of length ms at pitch 1, started on the first sample
+static t_cmgrainlabs *test_onegrain(double length, double samplerate) {
+	t_cmgrainlabs *x = test_new("hanning", 1, samplerate);
+	test_inlet(x, 1, 50.0);
+	test_inlet(x, 2, 50.0);
+	test_inlet(x, 3, length);
+	test_inlet(x, 4, length);
+	test_dsp(x, samplerate);
+	return x;
+}
+
+// render single samples until the grain has ended or limit samples have passed, returns the number of samples played
+static long test_lifetime(t_cmgrainlabs *x, double first, long limit) {
+	double trigger = first, zero = 0.0, left, right;
+	double *ins[9], *outs[2] = {&left, &right};
+	long k, samples = 0;
+	ins[0] = &trigger;
+	for (k = 1; k < 9; k++) {
+		ins[k] = &zero;
+	}
+	for (k = 0; k < limit; k++) {
+		cmgrainlabs_perform64(x, NULL, ins, 9, outs, 2, 1, 0, NULL);
+		trigger = -1.0; // no further triggers
+		if (!x->grains_count) {
+			break;
+		}
+		samples++;
+	}
+	return samples;
+}
+
+static int test_rate(int argc, char **argv) {
+	const double rates[] = {44100.0, 48000.0, 96000.0};
+	const long expected[] = {441, 480, 960}; // 10 ms in samples
+	long r, samples, failures = 0;
+	double position, speed;
+	t_cmgrainlabs *x;
+
+	for (r = 0; r < 3; r++) { // 10 ms grain at each rate
+		x = test_onegrain(10.0, rates[r]);
+		samples = test_lifetime(x, -1.0, 100000) + 1; // the trigger sample plays as well
+		printf("rate %.0f: 10 ms grain plays %ld samples (expected %ld)\n", rates[r], samples, expected[r]);
+		if (samples != expected[r]) {
+			failures++;
+		}
+		test_free(x);
+	}
+
+	// 20 ms grain, sample rate changes from 44.1 to 96 kHz after 10 ms
+	x = test_onegrain(20.0, 44100.0);
+	samples = test_lifetime(x, -1.0, 441) + 1;
+	position = x->start[0] + x->grainpos[0] * x->gr_length[0];
+	speed = x->grainstep[0] * x->gr_length[0];
+	test_dsp(x, 96000.0);
+	if (fabs(x->start[0] + x->grainpos[0] * x->gr_length[0] - position) > 1e-9) {
+		fprintf(stderr, "rate change: read position jumps from %f to %f\n", position, x->start[0] + x->grainpos[0] * x->gr_length[0]);
+		failures++;
+	}
+	if (fabs(x->grainstep[0] * x->gr_length[0] - speed) > 1e-9) {
+		fprintf(stderr, "rate change: pitch changes from %f to %f\n", speed, x->grainstep[0] * x->gr_length[0]);
+		failures++;
+	}
+	samples = test_lifetime(x, -1.0, 100000) + 1; // includes the sample that ends the grain
+	printf("rate change: remaining 10 ms play %ld samples at 96000 (expected 960)\n", samples);
+	if (samples != 960) {
+		failures++;
+	}
+	test_free(x);
+	
+	// 20 ms grain at the end of the buffer: after the rate change the rest of its source span is moved back into the buffer
+	x = test_onegrain(20.0, 44100.0);
+	test_inlet(x, 1, 1000.0); // past the end, the start is clamped to the last full grain
+	test_inlet(x, 2, 1000.0);
+	test_lifetime(x, -1.0, 441);
+	test_dsp(x, 96000.0);
+	if (!x->busy[0] || x->start[0] + x->gr_length[0] > TEST_SOURCEFRAMES || x->start[0] + x->grainpos[0] * x->gr_length[0] < 0.0) {
+		fprintf(stderr, "rate change: grain at the end of the buffer was cut off or reads outside the buffer\n");
+		failures++;
+	}
+	samples = test_lifetime(x, -1.0, 100000) + 1;
+	printf("rate change: grain at the buffer end plays %ld remaining samples at 96000 (expected 960)\n", samples);
+	if (samples != 960) {
+		failures++;
+	}
+	test_free(x);
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* INTERNAL SCHEDULER: A DENSITY CHANGE RESCHEDULES THE PENDING ONSET                                                   */
+/************************************************************************************************************************/
+static int test_sync(int argc, char **argv) {
+	long k, born = -1, failures = 0, phase = 0;
+	t_cmgrainlabs *x = test_new("hanning", 4, TEST_SR);
+	object_attr_setlong(x, gensym("sync"), 1);
+	object_attr_setfloat(x, gensym("density"), 0.01); // one grain per 100 s
+	test_inlet(x, 3, 1.0);
+	test_inlet(x, 4, 1.0);
+	test_dsp(x, TEST_SR);
+	test_render(x, TEST_VECTORSIZE * 2, &phase, NULL); // the first grain starts on the first sample and ends after 1 ms
+	object_attr_setfloat(x, gensym("density"), 100.0); // the pending onset is up to 100 s away
+	if (x->next_onset > TEST_SR / 100.0) {
+		fprintf(stderr, "sync: next onset %.0f samples away after the density change, period is %.0f\n", x->next_onset, TEST_SR / 100.0);
+		failures++;
+	}
+	for (k = 0; k < (long)(TEST_SR / 100.0) / TEST_VECTORSIZE + 1 && born < 0; k++) {
+		test_render(x, TEST_VECTORSIZE, &phase, NULL);
+		if (x->grains_count) {
+			born = (k + 1) * TEST_VECTORSIZE;
+		}
+	}
+	printf("sync: first grain after the density change within %ld samples (period %.0f)\n", born, TEST_SR / 100.0);
+	if (born < 0) {
+		failures++;
+	}
+	test_free(x);
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* ANALYSIS INDEX: BACKGROUND BUILD, MATCH LIST, ZERO CROSSING SNAP AND RELEASE WHILE BUILDING                          */
+/************************************************************************************************************************/
+// run queue elements until the match list is filled (the analysis thread sets them when it is done)
+static int test_waitindex(t_cmgrainlabs *x) {
+	struct timespec pause = {0, 1000000};
+	long k;
+	for (k = 0; k < 5000; k++) {
+		stub_qelem_run();
+		if (x->match_count) {
+			return 1;
+		}
+		nanosleep(&pause, NULL);
+	}
+	return 0;
+}
+
+static int test_index(int argc, char **argv) {
+	t_buffer_ref *ref = buffer_ref_new(NULL, gensym("source"));
+	t_buffer_obj *buffer = buffer_ref_getobject(ref);
+	float *samples = buffer_locksamples(buffer);
+	double mix, prev, output[TEST_VECTORSIZE * 2];
+	long i, k, crossing, matches, phase = 0, failures = 0, checked = 0;
+	t_cmgrainlabs_index *index;
+	t_cmgrainlabs *x, *y;
+
+	test_seed(0x1DE7);
+	x = test_new("hanning", 16, TEST_SR);
+	object_attr_setlong(x, gensym("select"), 1);
+	object_attr_setlong(x, gensym("snap"), 1);
+	x->attr_rms[0] = 0.2; // loud frames only
+	x->attr_rms[1] = 1.0;
+	test_inlet(x, 2, 300.0);
+	test_inlet(x, 3, 1.0);
+	test_inlet(x, 4, 3.0);
+	test_dsp(x, TEST_SR);
+	if (!test_waitindex(x)) {
+		fprintf(stderr, "index: no matching frames after 5 s\n");
+		test_free(x);
+		return 1;
+	}
+	index = x->index;
+	matches = x->match_count;
+	
+	// A FAILED INSTANTIATION DOES NOT JOIN THE SHARED INDEX
+	if (test_new("hanning", MAXGRAINS + 1, TEST_SR) != NULL || index->refcount != 1 || index->users != x || x->index_next != NULL) {
+		fprintf(stderr, "index: failed instance left in the shared index (refcount %ld)\n", index->refcount);
+		failures++;
+	}
+
+	// FRAME TABLE AND MATCH LIST
+	if (index->framecount != (TEST_SOURCEFRAMES + INDEX_HOPSIZE - 1) / INDEX_HOPSIZE) {
+		fprintf(stderr, "index: %ld frames\n", index->framecount);
+		failures++;
+	}
+	for (i = 0; i < x->match_count; i++) {
+		k = x->match[i] / INDEX_HOPSIZE;
+		if ((i && x->match[i] <= x->match[i - 1]) || index->frames[k].rms < x->attr_rms[0]) {
+			fprintf(stderr, "index: match %ld at %d is out of order or too quiet\n", i, x->match[i]);
+			failures++;
+		}
+	}
+
+	// ZERO CROSSINGS: EXACTLY THE UPWARD CROSSINGS OF THE CHANNEL MIX
+	crossing = 0;
+	prev = 0.0;
+	for (k = 0; k < TEST_SOURCEFRAMES; k++) {
+		mix = samples[k * 2] + samples[k * 2 + 1];
+		if (k > 0 && prev < 0.0 && mix >= 0.0) {
+			if (crossing >= index->crossingcount || index->crossings[crossing] != k) {
+				fprintf(stderr, "index: crossing %ld is not at %ld\n", crossing, k);
+				failures++;
+				break;
+			}
+			crossing++;
+		}
+		prev = mix;
+	}
+	if (crossing != index->crossingcount) {
+		fprintf(stderr, "index: %ld crossings, expected %ld\n", index->crossingcount, crossing);
+		failures++;
+	}
+	buffer_unlocksamples(buffer);
+	object_free(ref);
+
+	// SNAPPED GRAINS START ON A CROSSING
+	for (k = 0; k < 8; k++) {
+		test_render(x, TEST_VECTORSIZE, &phase, output);
+		for (i = 0; i < MAXGRAINS; i++) {
+			if (x->busy[i]) {
+				crossing = cmgrainlabs_lowerbound(index->crossings, index->crossingcount, x->start[i]);
+				if (crossing >= index->crossingcount || index->crossings[crossing] != x->start[i]) {
+					fprintf(stderr, "index: grain start %f is not a zero crossing\n", x->start[i]);
+					failures++;
+				}
+				checked++;
+			}
+		}
+	}
+
+	// A SECOND INSTANCE SHARES THE INDEX, RELEASING BOTH WHILE A REBUILD RUNS MUST NOT HANG OR CRASH
+	y = test_new("hanning", 16, TEST_SR);
+	if (y->index != index) {
+		fprintf(stderr, "index: not shared between instances on the same buffer\n");
+		failures++;
+	}
+	object_attr_setlong(y, gensym("snap"), 1);
+	index->dirty = 1; // as after a buffer_modified notification
+	stub_qelem_run(); // starts the rebuild
+	test_free(x);
+	test_free(y);
+
+	printf("index: %ld matches, %ld crossings, %ld snapped grain checks, %ld failures\n", matches, crossing, checked, failures);
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* PRECISION: FLOAT32 MODE AGAINST DOUBLE MODE                                                                          */
+/************************************************************************************************************************/
+// max absolute deviation between the two precision modes for long grains (window position drift)
+static double test_longgrains(void) {
+	double output[2][TEST_VECTORSIZE * 2], deviation, maxdeviation = 0.0;
+	t_cmgrainlabs *x[2];
+	uint64_t state[2]; // each instance draws from its own random sequence
+	long p, i, v, phase[2] = {0, 0};
+	for (p = 0; p < 2; p++) {
+		test_seed(0x10C6);
+		state[p] = test_state;
+		x[p] = test_new("hanning", 4, TEST_SR);
+		object_attr_setlong(x[p], gensym("w_interp"), 1);
+		object_attr_setlong(x[p], gensym("precision"), p);
+		object_attr_setfloat(x[p], gensym("maxlength"), 2000.0);
+		test_inlet(x[p], 2, 100.0);
+		test_inlet(x[p], 4, 2000.0); // 1 - 2 s grains at pitch 0.1 stay within the source
+		test_inlet(x[p], 3, 1000.0);
+		test_inlet(x[p], 5, 0.1);
+		test_inlet(x[p], 6, 0.1);
+		test_dsp(x[p], TEST_SR);
+	}
+	for (v = 0; v < (long)(3.0 * TEST_SR) / TEST_VECTORSIZE; v++) {
+		for (p = 0; p < 2; p++) {
+			test_state = state[p];
+			test_render(x[p], TEST_VECTORSIZE, &phase[p], output[p]);
+			state[p] = test_state;
+		}
+		for (i = 0; i < TEST_VECTORSIZE * 2; i++) {
+			deviation = fabs(output[0][i] - output[1][i]);
+			maxdeviation = deviation > maxdeviation ? deviation : maxdeviation;
+		}
+	}
+	test_free(x[0]);
+	test_free(x[1]);
+	return maxdeviation;
+}
+
+// allowed deviation for a window: the output tolerance plus the position error times the steepest window slope
+static double test_allowance(const char *window) {
+	t_buffer_ref *ref = buffer_ref_new(NULL, gensym(window));
+	t_buffer_obj *buffer = buffer_ref_getobject(ref);
+	float *samples = buffer_locksamples(buffer);
+	long k, channelcount = buffer_getchannelcount(buffer);
+	double slope = 0.0;
+	for (k = 1; k < buffer_getframecount(buffer); k++) {
+		slope = fabs(samples[k * channelcount] - samples[(k - 1) * channelcount]) > slope ? fabs(samples[k * channelcount] - samples[(k - 1) * channelcount]) : slope;
+	}
+	buffer_unlocksamples(buffer);
+	object_free(ref);
+	return PRECISION_TOLERANCE + PRECISION_POSITION * slope;
+}
+
+static int test_precision(int argc, char **argv) {
+	double single[GOLDEN_FRAMES * 2], reference[GOLDEN_FRAMES * 2], deviation, maxdeviation = 0.0, longgrains, allowance;
+	long w, c, i, failures = 0;
+	for (w = 0; w < TEST_WINDOWCOUNT; w++) {
+		allowance = test_allowance(test_windows[w]);
+		for (c = 0; c < 16; c++) {
+			test_goldencase(test_windows[w], c, 1, reference);
+			test_goldencase(test_windows[w], c, 0, single);
+			for (i = 0; i < GOLDEN_FRAMES * 2; i++) {
+				deviation = fabs(single[i] - reference[i]);
+				maxdeviation = deviation > maxdeviation ? deviation : maxdeviation;
+				if (deviation > allowance) {
+					fprintf(stderr, "%s case %ld frame %ld: float32 deviates by %g (allowed %g)\n", test_windows[w], c, i / 2, deviation, allowance);
+					failures++;
+					break;
+				}
+			}
+		}
+	}
+	longgrains = test_longgrains();
+	if (longgrains > test_allowance("hanning")) {
+		fprintf(stderr, "long grains: float32 deviates by %g\n", longgrains);
+		failures++;
+	}
+	printf("precision: max float32 deviation %g (golden cases), %g (long grains)\n", maxdeviation, longgrains);
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* BENCHMARK: NS PER GRAIN SAMPLE AGAINST THE RECORDED BASELINE (FAILS ABOVE THE ALLOWED REGRESSION)                    */
+/************************************************************************************************************************/
+static double test_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// reference workload measured next to every benchmark run: interpolated reads from the source buffer, ns per read
+static double test_calibrate(void) {
+	t_buffer_ref *ref = buffer_ref_new(NULL, gensym("source"));
+	t_buffer_obj *buffer = buffer_ref_getobject(ref);
+	float *samples = buffer_locksamples(buffer);
+	volatile double sink;
+	double sum = 0.0, distance = 0.0, start;
+	long k;
+	start = test_now();
+	for (k = 0; k < BENCH_CALIBRATION_READS; k++) {
+		sum += cmgrainlabs_lininterp(distance, samples, TEST_SOURCEFRAMES, 2, k & 1);
+		distance += 0.7;
+		if (distance >= TEST_SOURCEFRAMES) {
+			distance -= TEST_SOURCEFRAMES;
+		}
+	}
+	start = (test_now() - start) / BENCH_CALIBRATION_READS;
+	sink = sum;
+	(void)sink;
+	buffer_unlocksamples(buffer);
+	object_free(ref);
+	return start;
+}
+
+typedef struct _benchcase {
+	const char *name; // key in the baseline file
+	long precision; // precision attribute
+	long streaming; // multi-second grains on the long source instead of short grains
+	long prefetch; // streaming read path on (1) or off (0)
+	double ns; // fastest ns per grain sample
+	double ratio; // fastest ns per grain sample relative to the fastest calibration run (measured interleaved with the runs)
+	double baseline; // recorded ratio (0 if missing)
+} t_benchcase;
+
+// render with all voices busy, keeps the fastest of BENCH_RUNS runs
+static void test_benchrun(t_benchcase *c) {
+	long run, v, vectors = (long)(BENCH_SECONDS * TEST_SR) / TEST_VECTORSIZE, phase = 0;
+	double start, elapsed, calibration, fastest = 0.0, grainsamples;
+	t_cmgrainlabs *x;
+
+	c->ns = 0.0;
+	c->ratio = 0.0;
+	for (run = 0; run < BENCH_RUNS; run++) {
+		calibration = test_calibrate(); // the speed of this machine, measured between the runs so that both see the same conditions
+		if (fastest == 0.0 || calibration < fastest) {
+			fastest = calibration;
+		}
+		test_seed(0xBE7C4);
+		x = test_newsource(c->streaming ? "longsource" : "source", "hanning", MAXGRAINS, TEST_SR);
+		object_attr_setlong(x, gensym("stereo"), 1);
+		object_attr_setlong(x, gensym("w_interp"), 1);
+		object_attr_setlong(x, gensym("s_interp"), 1);
+		object_attr_setlong(x, gensym("precision"), c->precision);
+		object_attr_setlong(x, gensym("sync"), 1);
+		object_attr_setfloat(x, gensym("density"), 5000.0); // more onsets than voices: every voice stays busy
+		if (c->streaming) { // 2 - 4 s grains at pitch 1 - 2, spread over 16 s of source
+			object_attr_setfloat(x, gensym("maxlength"), 4000.0);
+			test_inlet(x, 2, 16000.0);
+			test_inlet(x, 4, 4000.0);
+			test_inlet(x, 3, 2000.0);
+			test_inlet(x, 5, 1.0);
+		}
+		else {
+			test_inlet(x, 2, 200.0);
+			test_inlet(x, 3, 80.0);
+			test_inlet(x, 4, 120.0);
+			test_inlet(x, 5, 0.5);
+		}
+		test_inlet(x, 6, 2.0);
+		test_inlet(x, 7, -1.0);
+		test_inlet(x, 8, 1.0);
+		test_dsp(x, TEST_SR);
+		if (!c->prefetch) {
+			x->stream_frames = HUGE_VAL; // long grains take the regular read path
+		}
+		test_render(x, TEST_VECTORSIZE * 64, &phase, NULL); // warm up until all voices are busy
+		grainsamples = 0.0;
+		start = test_now();
+		for (v = 0; v < vectors; v++) {
+			test_render(x, TEST_VECTORSIZE, &phase, NULL);
+			grainsamples += (double)x->grains_count * TEST_VECTORSIZE; // voices are refilled at once, so the count is near constant
+		}
+		elapsed = test_now() - start;
+		test_free(x);
+		if (grainsamples <= 0.0) {
+			continue;
+		}
+		if (c->ns == 0.0 || elapsed / grainsamples < c->ns) {
+			c->ns = elapsed / grainsamples;
+		}
+	}
+	c->ratio = fastest > 0.0 ? c->ns / fastest : 0.0;
+}
+
+static int test_bench(int argc, char **argv) {
+	int update = argc > 0 && !strcmp(argv[0], "--update");
+	const char *env = getenv("CMGRAINLABS_BENCH_MAX_REGRESSION");
+	double regression = env ? atof(env) : (argc > update ? atof(argv[update]) : 0.0);
+	t_benchcase cases[] = {
+		{"double", 1, 0, 1, 0.0, 0.0, 0.0},
+		{"float32", 0, 0, 1, 0.0, 0.0, 0.0},
+		{"streaming-double", 1, 1, 1, 0.0, 0.0, 0.0},
+		{"streaming-double-noprefetch", 1, 1, 0, 0.0, 0.0, 0.0},
+		{"streaming-float32", 0, 1, 1, 0.0, 0.0, 0.0},
+		{"streaming-float32-noprefetch", 0, 1, 0, 0.0, 0.0, 0.0},
+	};
+	long count = (long)(sizeof(cases) / sizeof(cases[0])), i, failures = 0;
+	double ns, ratio;
+	char path[1024], name[64], line[256];
+	FILE *f;
+
+	for (i = 0; i < count; i++) {
+		test_benchrun(&cases[i]);
+		if (cases[i].ns <= 0.0) {
+			fprintf(stderr, "bench: %s: no grains rendered\n", cases[i].name);
+			return 1;
+		}
+	}
+	snprintf(path, sizeof(path), "%s/bench.txt", CMGRAINLABS_GOLDEN_DIR);
+	if (update) {
+		f = fopen(path, "w");
+		if (f == NULL) {
+			fprintf(stderr, "could not write %s\n", path);
+			return 1;
+		}
+		fprintf(f, "# case, ns per grain sample, ns per grain sample relative to the calibration workload (compared by the test)\n");
+		fprintf(f, "# written by cmgrainlabs_test bench --update\n");
+		for (i = 0; i < count; i++) {
+			fprintf(f, "%s %.3f %.4f\n", cases[i].name, cases[i].ns, cases[i].ratio);
+			printf("bench: %s %.2f ns/grain-sample, ratio %.3f (recorded)\n", cases[i].name, cases[i].ns, cases[i].ratio);
+		}
+		fclose(f);
+		return 0;
+	}
+	f = fopen(path, "r");
+	while (f && fgets(line, sizeof(line), f)) {
+		if (line[0] != '#' && sscanf(line, "%63s %lf %lf", name, &ns, &ratio) == 3) {
+			for (i = 0; i < count; i++) {
+				if (!strcmp(name, cases[i].name)) {
+					cases[i].baseline = ratio;
+				}
+			}
+		}
+	}
+	if (f) {
+		fclose(f);
+	}
+	for (i = 0; i < count; i++) {
+		if (cases[i].baseline <= 0.0) {
+			fprintf(stderr, "bench: no baseline for %s in %s, record one with cmgrainlabs_test bench --update\n", cases[i].name, path);
+			failures++;
+			continue;
+		}
+		printf("bench: %s %.2f ns/grain-sample, ratio %.3f, baseline %.3f (%+.1f%%, limit +%.0f%%)\n", cases[i].name, cases[i].ns,
+				cases[i].ratio, cases[i].baseline, (cases[i].ratio / cases[i].baseline - 1.0) * 100.0, regression);
+		if (regression > 0.0 && cases[i].ratio > cases[i].baseline * (1.0 + regression * 0.01)) {
+			fprintf(stderr, "bench: %s regressed by more than %.0f%%\n", cases[i].name, regression);
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
+
+
+/************************************************************************************************************************/
+/* MAIN                                                                                                                 */
+/************************************************************************************************************************/
+typedef struct _test {
+	const char *name;
+	int (*run)(int argc, char **argv);
+} t_test;
+
+static const t_test tests[] = {
+	{"golden", test_golden}, // golden [--update]
+	{"rate", test_rate}, // rate
+	{"precision", test_precision}, // precision
+	{"sync", test_sync}, // sync
+	{"index", test_index}, // index
+	{"bench", test_bench}, // bench [--update] [max regression in percent]
+};
+
+int main(int argc, char **argv) {
+	long i;
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <test> [options]\n", argv[0]);
+		return 2;
+	}
+	cmgrainlabs_main(); // register the class
+	cmgrainlabs_random = test_random;
+	test_source();
+	if (!test_windowbuffers()) {
+		return 1;
+	}
+	for (i = 0; i < (long)(sizeof(tests) / sizeof(tests[0])); i++) {
+		if (!strcmp(argv[1], tests[i].name)) {
+			return tests[i].run(argc - 2, argv + 2);
+		}
+	}
+	fprintf(stderr, "unknown test %s\n", argv[1]);
+	return 2;
+}
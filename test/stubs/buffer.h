@@ -0,0 +1,16 @@
+#ifndef CMGRAINLABS_STUB_BUFFER_H
+#define CMGRAINLABS_STUB_BUFFER_H
+#include "ext.h"
+
+t_buffer_ref *buffer_ref_new(t_object *self, t_symbol *name);
+void buffer_ref_set(t_buffer_ref *x, t_symbol *name);
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *x);
+t_max_err buffer_ref_notify(t_buffer_ref *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
+float *buffer_locksamples(t_buffer_obj *buffer_object);
+void buffer_unlocksamples(t_buffer_obj *buffer_object);
+t_atom_long buffer_getframecount(t_buffer_obj *buffer_object);
+t_atom_long buffer_getchannelcount(t_buffer_obj *buffer_object);
+double buffer_getsamplerate(t_buffer_obj *buffer_object);
+t_max_err buffer_view(t_buffer_obj *buffer_object);
+
+#endif
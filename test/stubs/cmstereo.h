@@ -0,0 +1,11 @@
+#ifndef CMGRAINLABS_STUB_CMSTEREO_H
+#define CMGRAINLABS_STUB_CMSTEREO_H
+
+typedef struct cmpanner {
+	double left;
+	double right;
+} cm_panstruct;
+
+void cm_panning(cm_panstruct *panstruct, double *pos);
+
+#endif
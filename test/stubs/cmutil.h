@@ -0,0 +1,7 @@
+#ifndef CMGRAINLABS_STUB_CMUTIL_H
+#define CMGRAINLABS_STUB_CMUTIL_H
+#include "ext.h"
+
+double cm_random(double *min, double *max);
+
+#endif
@@ -0,0 +1,110 @@
+// Stand-in for the Max SDK headers used by cm.grainlabs~.c, just enough to build the external
+// into the headless test harness (test/cmgrainlabs_test.c). Behaviour lives in maxstubs.c.
+#ifndef CMGRAINLABS_STUB_EXT_H
+#define CMGRAINLABS_STUB_EXT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define C74_EXPORT
+
+typedef long t_atom_long;
+typedef int t_int32;
+typedef long t_max_err;
+typedef double t_double;
+typedef void *(*method)();
+typedef void (*t_perfroutine64)();
+
+typedef struct _object { void *o_class; } t_object;
+typedef struct _symbol { char *s_name; void *s_thing; } t_symbol;
+typedef struct _atom {
+	short a_type;
+	union {
+		t_atom_long w_long;
+		double w_float;
+		t_symbol *w_sym;
+	} a_w;
+} t_atom;
+typedef struct _pxobject { t_object z_ob; long z_in; } t_pxobject;
+typedef struct _class t_class;
+typedef struct _buffer_ref t_buffer_ref;
+typedef t_object t_buffer_obj; // as in the sdk
+typedef struct _hashtab t_hashtab;
+typedef struct _critical *t_critical;
+typedef struct _systhread *t_systhread;
+typedef struct _qelem *t_qelem;
+
+#define A_NOTHING 0
+#define A_LONG 1
+#define A_FLOAT 2
+#define A_SYM 3
+#define A_GIMME 8
+#define A_CANT 9
+
+#define CLASS_BOX 0
+#define MAX_ERR_NONE 0
+#define MAX_ERR_GENERIC -1
+#define ASSIST_INLET 1
+#define ASSIST_OUTLET 2
+#define OBJ_FLAG_REF 1
+#define OBJ_FLAG_DATA 2
+
+// CLASS AND ATTRIBUTES (ATTRIBUTES ARE REGISTERED SO THAT OBJECT_ATTR_SET* CALLS THE SETTERS LIKE MAX DOES)
+t_class *class_new(const char *name, method mnew, method mfree, long size, method mmenu, short type, ...);
+t_max_err class_addmethod(t_class *c, method m, const char *name, ...);
+t_max_err class_dspinit(t_class *c);
+t_max_err class_register(t_symbol *name_space, t_class *c);
+void stub_attr_new(t_class *c, const char *name, short type, long offset, long size);
+void stub_attr_accessors(t_class *c, const char *name, method setter);
+#define CLASS_BOX_SYM NULL
+#define CLASS_ATTR_ATOM_LONG(c, name, flags, type, member) stub_attr_new(c, name, A_LONG, offsetof(type, member), 1)
+#define CLASS_ATTR_LONG(c, name, flags, type, member) stub_attr_new(c, name, A_LONG, offsetof(type, member), 1)
+#define CLASS_ATTR_DOUBLE(c, name, flags, type, member) stub_attr_new(c, name, A_FLOAT, offsetof(type, member), 1)
+#define CLASS_ATTR_DOUBLE_ARRAY(c, name, flags, type, member, size) stub_attr_new(c, name, A_FLOAT, offsetof(type, member), size)
+#define CLASS_ATTR_ACCESSORS(c, name, getter, setter) stub_attr_accessors(c, name, setter)
+#define CLASS_ATTR_BASIC(c, name, flags)
+#define CLASS_ATTR_SAVE(c, name, flags)
+#define CLASS_ATTR_LABEL(c, name, flags, label)
+#define CLASS_ATTR_STYLE_LABEL(c, name, flags, style, label)
+#define CLASS_ATTR_ENUMINDEX(c, name, flags, list)
+#define CLASS_ATTR_ORDER(c, name, flags, order)
+
+// OBJECTS
+void *object_alloc(t_class *c);
+t_max_err object_free(void *x);
+void *object_method(void *x, t_symbol *s, ...);
+void object_error(t_object *x, const char *fmt, ...);
+void object_post(t_object *x, const char *fmt, ...);
+t_max_err object_attr_setlong(void *x, t_symbol *s, t_atom_long c);
+t_max_err object_attr_setfloat(void *x, t_symbol *s, double c);
+t_max_err attr_args_process(void *x, short ac, t_atom *av);
+void *intout(void *x);
+void *outlet_new(void *x, const char *type);
+void *outlet_int(void *o, t_atom_long n);
+void post(const char *fmt, ...);
+
+// ATOMS AND SYMBOLS
+t_symbol *gensym(const char *s);
+t_atom_long atom_getlong(const t_atom *a);
+double atom_getfloat(const t_atom *a);
+t_symbol *atom_getsym(const t_atom *a);
+t_atom_long atom_getintarg(short which, short ac, const t_atom *av);
+t_symbol *atom_getsymarg(short which, short ac, const t_atom *av);
+t_max_err atom_setlong(t_atom *a, t_atom_long b);
+t_max_err atom_setfloat(t_atom *a, double b);
+t_max_err atom_setsym(t_atom *a, t_symbol *b);
+void snprintf_zero(char *buffer, size_t count, const char *format, ...);
+
+// MEMORY
+void *sysmem_newptr(long size);
+void *sysmem_newptrclear(long size);
+void sysmem_freeptr(void *ptr);
+
+// QUEUE ELEMENTS
+void *qelem_new(void *obj, method fn);
+void qelem_set(void *q);
+void qelem_free(void *q);
+
+#endif
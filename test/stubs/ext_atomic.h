@@ -0,0 +1,4 @@
+#ifndef CMGRAINLABS_STUB_EXT_ATOMIC_H
+#define CMGRAINLABS_STUB_EXT_ATOMIC_H
+#include "ext.h"
+#endif
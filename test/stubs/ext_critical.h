@@ -0,0 +1,11 @@
+#ifndef CMGRAINLABS_STUB_EXT_CRITICAL_H
+#define CMGRAINLABS_STUB_EXT_CRITICAL_H
+#include "ext.h"
+
+void critical_new(t_critical *x);
+void critical_enter(t_critical x);
+void critical_exit(t_critical x);
+short critical_tryenter(t_critical x);
+void critical_free(t_critical x);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef CMGRAINLABS_STUB_EXT_HASHTAB_H
+#define CMGRAINLABS_STUB_EXT_HASHTAB_H
+#include "ext.h"
+
+t_hashtab *hashtab_new(long slotcount);
+void hashtab_flags(t_hashtab *x, long flags);
+t_max_err hashtab_store(t_hashtab *x, t_symbol *key, t_object *val);
+t_max_err hashtab_lookup(t_hashtab *x, t_symbol *key, t_object **val);
+t_max_err hashtab_chuckkey(t_hashtab *x, t_symbol *key);
+
+#endif
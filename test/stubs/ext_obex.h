@@ -0,0 +1,4 @@
+#ifndef CMGRAINLABS_STUB_EXT_OBEX_H
+#define CMGRAINLABS_STUB_EXT_OBEX_H
+#include "ext.h"
+#endif
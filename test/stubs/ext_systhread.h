@@ -0,0 +1,9 @@
+#ifndef CMGRAINLABS_STUB_EXT_SYSTHREAD_H
+#define CMGRAINLABS_STUB_EXT_SYSTHREAD_H
+#include "ext.h"
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread);
+long systhread_join(t_systhread thread, unsigned int *retval);
+void systhread_exit(long status);
+
+#endif
@@ -0,0 +1,544 @@
+// Stand-in Max runtime for the headless test harness: classes, attributes, atoms, buffers, queue elements,
+// critical regions and threads. Only the behaviour cm.grainlabs~.c relies on is implemented.
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include "ext.h"
+#include "z_dsp.h"
+#include "buffer.h"
+#include "ext_critical.h"
+#include "ext_hashtab.h"
+#include "ext_systhread.h"
+#include "cmstereo.h"
+#include "cmutil.h"
+#include "maxstubs.h"
+
+#define STUB_MAXATTRS 64
+#define STUB_MAXSYMBOLS 256
+#define STUB_MAXBUFFERS 32
+#define STUB_MAXQELEMS 64
+#define STUB_MAXKEYS 64
+
+
+/************************************************************************************************************************/
+/* CLASSES AND ATTRIBUTES                                                                                               */
+/************************************************************************************************************************/
+typedef struct _stub_attr {
+	const char *name;
+	short type;
+	long offset;
+	long size;
+	method setter;
+} t_stub_attr;
+
+struct _class {
+	long size;
+	t_stub_attr attrs[STUB_MAXATTRS];
+	long attrcount;
+};
+
+static struct _class stub_class; // the harness hosts a single class
+
+t_class *class_new(const char *name, method mnew, method mfree, long size, method mmenu, short type, ...) {
+	memset(&stub_class, 0, sizeof(stub_class));
+	stub_class.size = size;
+	return &stub_class;
+}
+
+t_max_err class_addmethod(t_class *c, method m, const char *name, ...) {
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_dspinit(t_class *c) {
+	return MAX_ERR_NONE;
+}
+
+t_max_err class_register(t_symbol *name_space, t_class *c) {
+	return MAX_ERR_NONE;
+}
+
+void stub_attr_new(t_class *c, const char *name, short type, long offset, long size) {
+	t_stub_attr *attr = &c->attrs[c->attrcount++];
+	attr->name = name;
+	attr->type = type;
+	attr->offset = offset;
+	attr->size = size;
+	attr->setter = NULL;
+}
+
+void stub_attr_accessors(t_class *c, const char *name, method setter) {
+	long i;
+	for (i = 0; i < c->attrcount; i++) {
+		if (!strcmp(c->attrs[i].name, name)) {
+			c->attrs[i].setter = setter;
+		}
+	}
+}
+
+static t_max_err stub_attr_set(void *x, t_symbol *s, t_atom *av) {
+	long i;
+	for (i = 0; i < stub_class.attrcount; i++) {
+		t_stub_attr *attr = &stub_class.attrs[i];
+		if (strcmp(attr->name, s->s_name)) {
+			continue;
+		}
+		if (attr->setter) {
+			return ((t_max_err (*)(void *, void *, long, t_atom *))attr->setter)(x, NULL, 1, av);
+		}
+		if (attr->type == A_LONG) {
+			*(t_atom_long *)((char *)x + attr->offset) = atom_getlong(av);
+		}
+		else {
+			*(double *)((char *)x + attr->offset) = atom_getfloat(av);
+		}
+		return MAX_ERR_NONE;
+	}
+	fprintf(stderr, "stub: unknown attribute %s\n", s->s_name);
+	return MAX_ERR_GENERIC;
+}
+
+t_max_err object_attr_setlong(void *x, t_symbol *s, t_atom_long c) {
+	t_atom a;
+	atom_setlong(&a, c);
+	return stub_attr_set(x, s, &a);
+}
+
+t_max_err object_attr_setfloat(void *x, t_symbol *s, double c) {
+	t_atom a;
+	atom_setfloat(&a, c);
+	return stub_attr_set(x, s, &a);
+}
+
+t_max_err attr_args_process(void *x, short ac, t_atom *av) {
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* OBJECTS, OUTLETS AND DSP                                                                                             */
+/************************************************************************************************************************/
+static t_perfroutine64 stub_perfroutine = NULL;
+static double stub_sr = 44100.0;
+
+void *object_alloc(t_class *c) {
+	return calloc(1, c->size);
+}
+
+t_max_err object_free(void *x) {
+	free(x); // only called for buffer references
+	return MAX_ERR_NONE;
+}
+
+void *object_method(void *x, t_symbol *s, ...) {
+	return NULL;
+}
+
+void object_error(t_object *x, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "error: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+void object_post(t_object *x, const char *fmt, ...) {
+}
+
+void post(const char *fmt, ...) {
+}
+
+void *intout(void *x) {
+	return NULL;
+}
+
+void *outlet_new(void *x, const char *type) {
+	return NULL;
+}
+
+void *outlet_int(void *o, t_atom_long n) {
+	return NULL;
+}
+
+void dsp_setup(t_pxobject *x, long nsignals) {
+}
+
+void dsp_free(t_pxobject *x) {
+}
+
+void dsp_add64(t_object *chain, t_object *x, t_perfroutine64 f, long flags, void *userparam) {
+	stub_perfroutine = f;
+}
+
+t_perfroutine64 stub_perform(void) {
+	return stub_perfroutine;
+}
+
+double sys_getsr(void) {
+	return stub_sr;
+}
+
+void stub_set_sr(double samplerate) {
+	stub_sr = samplerate;
+}
+
+
+/************************************************************************************************************************/
+/* ATOMS AND SYMBOLS                                                                                                    */
+/************************************************************************************************************************/
+t_symbol *gensym(const char *s) {
+	static t_symbol symbols[STUB_MAXSYMBOLS];
+	static long count = 0;
+	long i;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(symbols[i].s_name, s)) {
+			return &symbols[i];
+		}
+	}
+	symbols[count].s_name = strdup(s);
+	return &symbols[count++];
+}
+
+t_atom_long atom_getlong(const t_atom *a) {
+	return a->a_type == A_FLOAT ? (t_atom_long)a->a_w.w_float : a->a_w.w_long;
+}
+
+double atom_getfloat(const t_atom *a) {
+	return a->a_type == A_FLOAT ? a->a_w.w_float : (double)a->a_w.w_long;
+}
+
+t_symbol *atom_getsym(const t_atom *a) {
+	return a->a_type == A_SYM ? a->a_w.w_sym : gensym("");
+}
+
+t_atom_long atom_getintarg(short which, short ac, const t_atom *av) {
+	return which < ac ? atom_getlong(av + which) : 0;
+}
+
+t_symbol *atom_getsymarg(short which, short ac, const t_atom *av) {
+	return which < ac ? atom_getsym(av + which) : gensym("");
+}
+
+t_max_err atom_setlong(t_atom *a, t_atom_long b) {
+	a->a_type = A_LONG;
+	a->a_w.w_long = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setfloat(t_atom *a, double b) {
+	a->a_type = A_FLOAT;
+	a->a_w.w_float = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setsym(t_atom *a, t_symbol *b) {
+	a->a_type = A_SYM;
+	a->a_w.w_sym = b;
+	return MAX_ERR_NONE;
+}
+
+void snprintf_zero(char *buffer, size_t count, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, count, format, args);
+	va_end(args);
+}
+
+
+/************************************************************************************************************************/
+/* MEMORY                                                                                                               */
+/************************************************************************************************************************/
+void *sysmem_newptr(long size) {
+	return malloc(size > 0 ? size : 1);
+}
+
+void *sysmem_newptrclear(long size) {
+	return calloc(1, size > 0 ? size : 1);
+}
+
+void sysmem_freeptr(void *ptr) {
+	free(ptr);
+}
+
+
+/************************************************************************************************************************/
+/* BUFFERS                                                                                                              */
+/************************************************************************************************************************/
+typedef struct _stub_buffer {
+	t_object ob;
+	t_symbol *name;
+	float *samples; // exactly framecount frames, so the sanitizer builds catch reads past the end
+	long framecount;
+	long channelcount;
+	double samplerate;
+} t_stub_buffer;
+
+struct _buffer_ref {
+	t_symbol *name;
+};
+
+static t_stub_buffer stub_buffers[STUB_MAXBUFFERS];
+static long stub_buffercount = 0;
+
+void stub_buffer_set(const char *name, const float *samples, long framecount, long channelcount, double samplerate) {
+	t_symbol *s = gensym(name);
+	t_stub_buffer *b = NULL;
+	long i;
+	for (i = 0; i < stub_buffercount; i++) {
+		if (stub_buffers[i].name == s) {
+			b = &stub_buffers[i];
+			free(b->samples);
+		}
+	}
+	if (b == NULL) {
+		b = &stub_buffers[stub_buffercount++];
+	}
+	b->name = s;
+	b->framecount = framecount;
+	b->channelcount = channelcount;
+	b->samplerate = samplerate;
+	b->samples = malloc(framecount * channelcount * sizeof(float));
+	memcpy(b->samples, samples, framecount * channelcount * sizeof(float));
+}
+
+t_buffer_ref *buffer_ref_new(t_object *self, t_symbol *name) {
+	t_buffer_ref *x = calloc(1, sizeof(t_buffer_ref));
+	x->name = name;
+	return x;
+}
+
+void buffer_ref_set(t_buffer_ref *x, t_symbol *name) {
+	x->name = name;
+}
+
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *x) {
+	long i;
+	for (i = 0; x && i < stub_buffercount; i++) {
+		if (stub_buffers[i].name == x->name) {
+			return (t_buffer_obj *)&stub_buffers[i];
+		}
+	}
+	return NULL;
+}
+
+t_max_err buffer_ref_notify(t_buffer_ref *x, t_symbol *s, t_symbol *msg, void *sender, void *data) {
+	return MAX_ERR_NONE;
+}
+
+float *buffer_locksamples(t_buffer_obj *buffer_object) {
+	return buffer_object ? ((t_stub_buffer *)buffer_object)->samples : NULL;
+}
+
+void buffer_unlocksamples(t_buffer_obj *buffer_object) {
+}
+
+t_atom_long buffer_getframecount(t_buffer_obj *buffer_object) {
+	return buffer_object ? ((t_stub_buffer *)buffer_object)->framecount : 0;
+}
+
+t_atom_long buffer_getchannelcount(t_buffer_obj *buffer_object) {
+	return buffer_object ? ((t_stub_buffer *)buffer_object)->channelcount : 0;
+}
+
+double buffer_getsamplerate(t_buffer_obj *buffer_object) {
+	return buffer_object ? ((t_stub_buffer *)buffer_object)->samplerate : 0.0;
+}
+
+t_max_err buffer_view(t_buffer_obj *buffer_object) {
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* QUEUE ELEMENTS                                                                                                       */
+/************************************************************************************************************************/
+typedef struct _stub_qelem {
+	void *obj;
+	method fn;
+	volatile int set;
+} t_stub_qelem;
+
+static t_stub_qelem *stub_qelems[STUB_MAXQELEMS];
+static pthread_mutex_t stub_qelem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *qelem_new(void *obj, method fn) {
+	t_stub_qelem *q = calloc(1, sizeof(t_stub_qelem));
+	long i;
+	q->obj = obj;
+	q->fn = fn;
+	pthread_mutex_lock(&stub_qelem_lock);
+	for (i = 0; i < STUB_MAXQELEMS; i++) {
+		if (stub_qelems[i] == NULL) {
+			stub_qelems[i] = q;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stub_qelem_lock);
+	return q;
+}
+
+void qelem_set(void *q) {
+	pthread_mutex_lock(&stub_qelem_lock);
+	((t_stub_qelem *)q)->set = 1;
+	pthread_mutex_unlock(&stub_qelem_lock);
+}
+
+void qelem_free(void *q) {
+	long i;
+	pthread_mutex_lock(&stub_qelem_lock);
+	for (i = 0; i < STUB_MAXQELEMS; i++) {
+		if (stub_qelems[i] == q) {
+			stub_qelems[i] = NULL;
+		}
+	}
+	pthread_mutex_unlock(&stub_qelem_lock);
+	free(q);
+}
+
+void stub_qelem_run(void) {
+	t_stub_qelem *q;
+	long i;
+	for (i = 0; i < STUB_MAXQELEMS; i++) {
+		pthread_mutex_lock(&stub_qelem_lock);
+		q = stub_qelems[i];
+		if (q && q->set) {
+			q->set = 0;
+		}
+		else {
+			q = NULL;
+		}
+		pthread_mutex_unlock(&stub_qelem_lock);
+		if (q) {
+			((void (*)(void *))q->fn)(q->obj); // queue elements run on the main (test) thread
+		}
+	}
+}
+
+
+/************************************************************************************************************************/
+/* HASH TABLE (LINEAR LOOKUP, THE HARNESS ONLY STORES A FEW KEYS)                                                       */
+/************************************************************************************************************************/
+struct _hashtab {
+	t_symbol *keys[STUB_MAXKEYS];
+	t_object *vals[STUB_MAXKEYS];
+};
+
+t_hashtab *hashtab_new(long slotcount) {
+	return calloc(1, sizeof(t_hashtab));
+}
+
+void hashtab_flags(t_hashtab *x, long flags) {
+}
+
+t_max_err hashtab_store(t_hashtab *x, t_symbol *key, t_object *val) {
+	long i;
+	for (i = 0; i < STUB_MAXKEYS; i++) {
+		if (x->keys[i] == key || x->keys[i] == NULL) {
+			x->keys[i] = key;
+			x->vals[i] = val;
+			return MAX_ERR_NONE;
+		}
+	}
+	return MAX_ERR_GENERIC;
+}
+
+t_max_err hashtab_lookup(t_hashtab *x, t_symbol *key, t_object **val) {
+	long i;
+	for (i = 0; i < STUB_MAXKEYS; i++) {
+		if (x->keys[i] == key) {
+			*val = x->vals[i];
+			return MAX_ERR_NONE;
+		}
+	}
+	*val = NULL;
+	return MAX_ERR_GENERIC;
+}
+
+t_max_err hashtab_chuckkey(t_hashtab *x, t_symbol *key) {
+	long i;
+	for (i = 0; i < STUB_MAXKEYS; i++) {
+		if (x->keys[i] == key) {
+			x->keys[i] = NULL;
+			x->vals[i] = NULL;
+			return MAX_ERR_NONE;
+		}
+	}
+	return MAX_ERR_GENERIC;
+}
+
+
+/************************************************************************************************************************/
+/* CRITICAL REGIONS AND THREADS                                                                                         */
+/************************************************************************************************************************/
+struct _critical {
+	pthread_mutex_t mutex;
+};
+
+void critical_new(t_critical *x) {
+	pthread_mutexattr_t attr;
+	*x = malloc(sizeof(struct _critical));
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE); // max critical regions are reentrant
+	pthread_mutex_init(&(*x)->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void critical_enter(t_critical x) {
+	pthread_mutex_lock(&x->mutex);
+}
+
+void critical_exit(t_critical x) {
+	pthread_mutex_unlock(&x->mutex);
+}
+
+short critical_tryenter(t_critical x) {
+	return pthread_mutex_trylock(&x->mutex) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+void critical_free(t_critical x) {
+	pthread_mutex_destroy(&x->mutex);
+	free(x);
+}
+
+struct _systhread {
+	pthread_t thread;
+};
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread) {
+	t_systhread x = malloc(sizeof(struct _systhread));
+	if (pthread_create(&x->thread, NULL, (void *(*)(void *))entryproc, arg)) {
+		free(x);
+		return MAX_ERR_GENERIC;
+	}
+	*thread = x;
+	return MAX_ERR_NONE;
+}
+
+long systhread_join(t_systhread thread, unsigned int *retval) {
+	pthread_join(thread->thread, NULL);
+	free(thread);
+	if (retval) {
+		*retval = 0;
+	}
+	return MAX_ERR_NONE;
+}
+
+void systhread_exit(long status) {
+	pthread_exit(NULL);
+}
+
+
+/************************************************************************************************************************/
+/* CM.LIBRARY FUNCTIONS                                                                                                 */
+/************************************************************************************************************************/
+// uniform random value between min and max (the harness replaces the external's random hook with a seeded generator)
+double cm_random(double *min, double *max) {
+	return *min + ((*max - *min) * (rand() / (RAND_MAX + 1.0)));
+}
+
+// constant power panning (-1 = left, 1 = right)
+void cm_panning(cm_panstruct *panstruct, double *pos) {
+	double angle = *pos * M_PI * 0.25;
+	panstruct->left = (M_SQRT2 * 0.5) * (cos(angle) - sin(angle));
+	panstruct->right = (M_SQRT2 * 0.5) * (cos(angle) + sin(angle));
+}
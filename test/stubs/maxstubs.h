@@ -0,0 +1,15 @@
+// Test-only controls for the stand-in Max runtime in maxstubs.c.
+#ifndef CMGRAINLABS_MAXSTUBS_H
+#define CMGRAINLABS_MAXSTUBS_H
+#include "ext.h"
+
+// register (or replace) the contents of the buffer~ called name (interleaved samples, copied)
+void stub_buffer_set(const char *name, const float *samples, long framecount, long channelcount, double samplerate);
+// run all queue elements that have been set (the analysis thread sets them as well)
+void stub_qelem_run(void);
+// system sample rate returned by sys_getsr
+void stub_set_sr(double samplerate);
+// the perform routine of the last dsp_add64 call
+t_perfroutine64 stub_perform(void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef CMGRAINLABS_STUB_Z_DSP_H
+#define CMGRAINLABS_STUB_Z_DSP_H
+#include "ext.h"
+
+void dsp_setup(t_pxobject *x, long nsignals);
+void dsp_free(t_pxobject *x);
+void dsp_add64(t_object *chain, t_object *x, t_perfroutine64 f, long flags, void *userparam);
+double sys_getsr(void);
+
+#endif